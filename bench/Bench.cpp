@@ -0,0 +1,184 @@
+#include "Bench.hpp"
+
+#include "CudaFitnessEngine.hpp"
+#include "GlobalConfig.hpp"
+#include "JSONSerializer.hpp"
+#include "STFitnessEngine.hpp"
+#include "globalRNG.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <ostream>
+#include <random>
+
+#include <omp.h>
+
+GA_NAMESPACE_BEGIN
+
+namespace bench {
+
+// Smooth gradient with random translucent rectangles on top: it has both flat
+// regions and edges, like a real photo, and doesn't need any file.
+static void generateTarget(Image& image, Workload const& workload) {
+    image.create(workload.width, workload.height);
+    u8* data = image.getData();
+
+    const i32 width = workload.width;
+    const i32 height = workload.height;
+    for (i32 y = 0; y < height; ++y) {
+        for (i32 x = 0; x < width; ++x) {
+            u8* pixel = &data[(y * width + x) * 4];
+            pixel[0] = static_cast<u8>(255 * x / std::max(1, width - 1));
+            pixel[1] = static_cast<u8>(255 * y / std::max(1, height - 1));
+            pixel[2] = static_cast<u8>(128 + 127 * std::sin(0.05 * (x + y)));
+            pixel[3] = 255;
+        }
+    }
+
+    std::mt19937 rng(workload.seed);
+    std::uniform_int_distribution<i32> xDist(0, width - 1);
+    std::uniform_int_distribution<i32> yDist(0, height - 1);
+    std::uniform_int_distribution<i32> colorDist(0, 255);
+    for (i32 i = 0; i < 32; ++i) {
+        i32 x0 = xDist(rng), x1 = xDist(rng);
+        i32 y0 = yDist(rng), y1 = yDist(rng);
+        i32 color[3] = {colorDist(rng), colorDist(rng), colorDist(rng)};
+        for (i32 y = std::min(y0, y1); y <= std::max(y0, y1); ++y) {
+            for (i32 x = std::min(x0, x1); x <= std::max(x0, x1); ++x) {
+                u8* pixel = &data[(y * width + x) * 4];
+                for (i32 c = 0; c < 3; ++c)
+                    pixel[c] = static_cast<u8>((pixel[c] + color[c]) / 2);
+            }
+        }
+    }
+
+    image.prepare();
+}
+
+std::vector<std::string> defaultEngines() {
+    std::vector<std::string> engines = {"ST", "MT"};
+    if (CudaFitnessEngine<>::isAvailable())
+        engines.push_back("CUDA");
+    return engines;
+}
+
+std::unique_ptr<FitnessEngine> createEngine(std::string const& name, FitnessMetric metric) {
+    std::string upper = name;
+    for (char& c : upper)
+        c = std::toupper(c);
+
+    // The CUDA engine aborts without a device
+    if (upper == "CUDA" && !CudaFitnessEngine<>::isAvailable()) {
+        std::fprintf(stderr, "genalgo_bench: No CUDA device available\n");
+        return nullptr;
+    }
+
+    std::unique_ptr<FitnessEngine> engine = createFitnessEngine(name, metric);
+    if (!engine)
+        std::fprintf(stderr, "genalgo_bench: Unknown fitness engine: %s\n", name.c_str());
+    return engine;
+}
+
+void setupWorkload(Workload const& workload) {
+    globalCfg.loadConstants();
+    globalCfg.seed = workload.seed;
+    globalCfg.populationSize = workload.populationSize;
+    globalCfg.numTriangles = workload.numTriangles;
+    globalCfg.breedPoolSize = std::min(globalCfg.breedPoolSize, workload.populationSize);
+    globalCfg.eliteSize = std::min(globalCfg.eliteSize, workload.populationSize);
+
+    generateTarget(globalCfg.targetImage, workload);
+    globalRNG.seed(workload.seed);
+}
+
+Population makePopulation(Workload const& workload) {
+    globalRNG.seed(workload.seed);
+
+    Population population;
+    population.populate(workload.populationSize, workload.numTriangles);
+
+    STFitnessEngine<> engine;
+    population.evaluate(engine);
+    return population;
+}
+
+void Result::setSamples(std::vector<f64>& times) {
+    samples = static_cast<i32>(times.size());
+    if (times.empty())
+        return;
+
+    std::sort(times.begin(), times.end());
+    std::size_t n = times.size();
+    median = n % 2 ? times[n / 2] : 0.5 * (times[n / 2 - 1] + times[n / 2]);
+    min = times.front();
+
+    f64 sum = 0;
+    for (f64 t : times)
+        sum += t;
+    mean = sum / n;
+
+    f64 variance = 0;
+    for (f64 t : times)
+        variance += (t - mean) * (t - mean);
+    stddev = n > 1 ? std::sqrt(variance / (n - 1)) : 0;
+}
+
+bool Runner::enabled(std::string const& name) const {
+    return filter.empty() || name.find(filter) != std::string::npos;
+}
+
+void Runner::reseed() const {
+    globalRNG.seed(workload.seed);
+}
+
+void Runner::addResult(std::string const& name, u64 iterations, std::vector<f64>& times, f64 itemsPerOp, std::string itemName) {
+    Result result;
+    result.name = name;
+    result.iterations = iterations;
+    result.itemsPerOp = itemsPerOp;
+    result.itemName = std::move(itemName);
+    result.setSamples(times);
+    results.push_back(std::move(result));
+}
+
+void Runner::writeJSON(std::ostream& os) const {
+    json::serialize(os, [&](JSONSerializerState& state) {
+        state.serialize_object()
+            .add("workload", [&](JSONSerializerState& state) {
+                state.serialize_object()
+                    .add("seed", workload.seed)
+                    .add("width", workload.width)
+                    .add("height", workload.height)
+                    .add("population", workload.populationSize)
+                    .add("triangles", workload.numTriangles)
+                    .add("threads", omp_get_max_threads());
+            })
+            .add("benchmarks", [&](JSONSerializerState& state) {
+                JSONArrayBuilder array = state.serialize_array();
+                for (Result const& result : results) {
+                    array.add([&](JSONSerializerState& state) {
+                        JSONObjectBuilder obj = state.serialize_object();
+                        obj.add("name", std::string_view(result.name))
+                           .add("iterations", result.iterations)
+                           .add("samples", result.samples)
+                           .add("median_ns", result.median)
+                           .add("min_ns", result.min)
+                           .add("mean_ns", result.mean)
+                           .add("stddev_ns", result.stddev);
+
+                        // Throughput of the median sample
+                        if (result.itemsPerOp > 0) {
+                            obj.add("items", std::string_view(result.itemName))
+                               .add("items_per_second", 1e9 * result.itemsPerOp / result.median);
+                        }
+                    });
+                }
+            });
+    });
+    os << '\n';
+}
+
+}
+
+GA_NAMESPACE_END
@@ -0,0 +1,180 @@
+#ifndef GENALGO_BENCH_HPP
+#define GENALGO_BENCH_HPP
+
+#include "base.hpp"
+#include "FitnessEngine.hpp"
+#include "Population.hpp"
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+GA_NAMESPACE_BEGIN
+
+namespace bench {
+
+// Prevents the compiler from discarding a value that is never used
+template <typename T>
+inline void doNotOptimize(T const& value) {
+    asm volatile("" : : "m"(value) : "memory");
+}
+
+// Synthetic, seeded workload. The same configuration always produces the same
+// target and population, so results can be compared between runs.
+struct Workload {
+    u32 seed = 1;
+    i32 width = 256;
+    i32 height = 256;
+    i32 populationSize = 50;
+    i32 numTriangles = 100;
+};
+
+struct Options {
+    const char* command = "micro";
+    const char* outputFilename = nullptr;
+    std::string filter;
+    f64 minTime = 0.5;      // Seconds
+    i32 samples = 10;
+    Workload workload;
+    FitnessMetric metric = FitnessMetric::l2;   // Of the engines of scaling, replay and diff
+    bool frontToBack = false;   // Front-to-back compositing of the CPU engines (see GlobalConfig)
+    f64 minTransmittance = 0;
+    bool fixedPoint = false;    // Integer pipeline of the CPU engines
+    bool batchDisabled = false; // Batched evaluation of small targets by the MT engine
+
+    // Scaling matrix, threads defaults to powers of two up to the number of cores
+    const char* engine = "MT";
+    i64 generations = 0;    // If 0, each configuration runs for minTime
+    std::vector<i32> threads;
+    std::vector<i32> sizes = {256, 512, 1024, 2048, 4096};
+    std::vector<i32> populations = {50, 200};
+    std::vector<i32> triangleCounts = {50, 200};
+
+    // Checkpoint replay, engines defaults to all the available engines
+    const char* imageFilename = nullptr;
+    const char* inputFilename = nullptr;
+    std::vector<std::string> engines;
+    i32 iterations = 10;
+
+    // Differential test of the engines
+    i32 rounds = 20;
+    f64 tolerance = 1e-4;       // Relative error of the fitness
+    f64 pixelTolerance = 0.5;   // Difference of a channel of a pixel, out of 255
+};
+
+// Commands, they return the exit code
+int runMicro(Options const& options);
+int runScaling(Options const& options);
+int runReplay(Options const& options);
+int runDiff(Options const& options);
+
+// Engines to use when none is given: ST, MT, and CUDA if there is a device
+std::vector<std::string> defaultEngines();
+
+// Creates the engine for the current globalCfg. Prints an error and returns nullptr
+// if the name is unknown or there is no CUDA device.
+std::unique_ptr<FitnessEngine> createEngine(std::string const& name, FitnessMetric metric);
+
+// Writes to the file, or to stdout if there is no filename
+template <typename F>
+bool writeOutput(const char* filename, F&& write) {
+    if (!filename) {
+        write(std::cout);
+        return static_cast<bool>(std::cout.flush());
+    }
+
+    std::ofstream output(filename);
+    if (!output) {
+        std::cerr << "genalgo_bench: Failed to open file " << filename << std::endl;
+        return false;
+    }
+    write(output);
+    return static_cast<bool>(output);
+}
+
+// Loads the default constants into globalCfg, generates the target image and
+// seeds globalRNG. Must be called before creating engines or populations.
+void setupWorkload(Workload const& workload);
+
+// Random population of the workload, with the fitness already evaluated
+// (so it can be bred).
+Population makePopulation(Workload const& workload);
+
+struct Result {
+    std::string name;
+    u64 iterations = 0;     // Per sample
+    i32 samples = 0;
+
+    // Nanoseconds per operation
+    f64 median = 0;
+    f64 min = 0;
+    f64 mean = 0;
+    f64 stddev = 0;
+
+    // Optional throughput, e.g. pixels per operation
+    f64 itemsPerOp = 0;
+    std::string itemName;
+
+    // Computes the statistics of the samples (nanoseconds per operation), sorts times
+    void setSamples(std::vector<f64>& times);
+};
+
+class Runner {
+public:
+    Runner(Workload const& workload, f64 minTime, i32 samples, std::string filter)
+        : workload(workload), minTime(minTime), samples(samples), filter(std::move(filter)) {}
+
+    bool enabled(std::string const& name) const;
+
+    // Runs op() repeatedly. Each benchmark starts with globalRNG seeded with the
+    // seed of the workload, so the random streams are reproducible.
+    template <typename F>
+    void run(std::string const& name, F&& op, f64 itemsPerOp = 0, std::string itemName = {}) {
+        if (!enabled(name))
+            return;
+
+        reseed();
+        auto batch = [&](u64 iterations) {
+            auto start = std::chrono::steady_clock::now();
+            for (u64 i = 0; i < iterations; ++i)
+                op();
+            return std::chrono::duration<f64, std::nano>(std::chrono::steady_clock::now() - start).count();
+        };
+
+        // Calibration also warms up caches and allocators
+        u64 iterations = 1;
+        f64 target = 1e9 * minTime / samples;
+        while (batch(iterations) < target && iterations < (u64(1) << 40))
+            iterations *= 2;
+
+        std::vector<f64> times(samples);
+        for (f64& t : times)
+            t = batch(iterations) / iterations;
+
+        addResult(name, iterations, times, itemsPerOp, std::move(itemName));
+    }
+
+    Workload const& getWorkload() const noexcept { return workload; }
+    std::vector<Result> const& getResults() const noexcept { return results; }
+
+    // Stable JSON: fixed key order, benchmarks in execution order
+    void writeJSON(std::ostream& os) const;
+
+private:
+    void reseed() const;
+    void addResult(std::string const& name, u64 iterations, std::vector<f64>& times, f64 itemsPerOp, std::string itemName);
+
+    Workload workload;
+    f64 minTime;
+    i32 samples;
+    std::string filter;
+    std::vector<Result> results;
+};
+
+}
+
+GA_NAMESPACE_END
+
+#endif // GENALGO_BENCH_HPP
@@ -0,0 +1,281 @@
+#include "Bench.hpp"
+
+#include "Color.hpp"
+#include "FitnessEngine.hpp"
+#include "GlobalConfig.hpp"
+#include "JSONSerializer.hpp"
+#include "Rasterizer.hpp"
+#include "Vec.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+GA_NAMESPACE_BEGIN
+
+namespace bench {
+
+// Only the first ones are reported
+constexpr std::size_t MAX_MISMATCHES = 20;
+
+struct Mismatch {
+    i32 round, individual;
+    i32 width, height;
+    i32 x, y;
+    Vec3d expected, actual;
+};
+
+struct EngineDiff {
+    std::string name;
+    bool canvas = true;         // The engine exposes its canvases, so coverage is checked
+    i64 individuals = 0;
+
+    // Fitness compared with the reference fitness
+    f64 maxRelativeError = 0;
+    i64 failures = 0;
+
+    // Canvases compared with the reference rasterizer
+    i64 pixels = 0;
+    i64 mismatchedPixels = 0;
+    f64 maxPixelError = 0;
+    std::vector<Mismatch> mismatches;
+
+    bool passed() const noexcept { return failures == 0 && mismatchedPixels == 0; }
+};
+
+// Random triangles, including the cases an optimized rasterizer is likely to get wrong:
+// vertices on the border of or outside the image, degenerate and tiny triangles, and alphas
+// of 0 and 255.
+static Triangle randomTriangle(std::mt19937& rng, i32 width, i32 height) {
+    auto uniform = [&](i32 min, i32 max) { return std::uniform_int_distribution<i32>(min, max)(rng); };
+    auto randomPoint = [&]() { return Point<i32>{uniform(0, width - 1), uniform(0, height - 1)}; };
+
+    Triangle t;
+    switch (uniform(0, 4)) {
+    case 0: // Anywhere
+        t.a = randomPoint();
+        t.b = randomPoint();
+        t.c = randomPoint();
+        break;
+    case 1: { // On the border of the image
+        auto borderPoint = [&]() {
+            Point<i32> p = randomPoint();
+            switch (uniform(0, 3)) {
+            case 0: p.x = 0; break;
+            case 1: p.x = width - 1; break;
+            case 2: p.y = 0; break;
+            default: p.y = height - 1; break;
+            }
+            return p;
+        };
+        t.a = borderPoint();
+        t.b = borderPoint();
+        t.c = borderPoint();
+        break;
+    }
+    case 2: // Degenerate: a segment or a point
+        t.a = randomPoint();
+        t.b = randomPoint();
+        t.c = t.a;
+        if (uniform(0, 1)) {
+            t.b.y = t.a.y;
+            t.c.x = uniform(0, width - 1);
+        }
+        break;
+    case 3: { // Partly or entirely outside of the image
+        auto outsidePoint = [&]() { return Point<i32>{uniform(-width, 2 * width), uniform(-height, 2 * height)}; };
+        t.a = outsidePoint();
+        t.b = outsidePoint();
+        t.c = outsidePoint();
+        break;
+    }
+    default: { // A few pixels wide
+        t.a = randomPoint();
+        auto near = [&](Point<i32> p) {
+            return Point<i32>{std::clamp(p.x + uniform(-3, 3), 0, width - 1),
+                              std::clamp(p.y + uniform(-3, 3), 0, height - 1)};
+        };
+        t.b = near(t.a);
+        t.c = near(t.a);
+        break;
+    }
+    }
+
+    auto channel = [&]() {
+        i32 kind = uniform(0, 7);
+        return static_cast<u8>(kind == 0 ? 0 : kind == 1 ? 255 : uniform(0, 255));
+    };
+    t.color = Color{channel(), channel(), channel(), channel()};
+    return t;
+}
+
+static std::vector<Individual> randomIndividuals(std::mt19937& rng, i32 count, i32 maxTriangles, i32 width, i32 height) {
+    std::vector<Individual> individuals(count);
+    std::uniform_int_distribution<i32> sizeDist(0, maxTriangles);
+    for (Individual& individual : individuals) {
+        i32 size = sizeDist(rng);
+        for (i32 i = 0; i < size; ++i)
+            individual.push_back(randomTriangle(rng, width, height));
+    }
+    return individuals;
+}
+
+static bool diffRound(Options const& options, i32 round, std::vector<std::string> const& engines, std::vector<EngineDiff>& diffs) {
+    std::mt19937 rng(options.workload.seed + round);
+
+    // The first round uses the size of the workload, the others random sizes up to it,
+    // so the partial tiles of tiled engines are exercised
+    Workload workload = options.workload;
+    workload.seed = options.workload.seed + round;
+    if (round > 0) {
+        workload.width = std::uniform_int_distribution<i32>(1, options.workload.width)(rng);
+        workload.height = std::uniform_int_distribution<i32>(1, options.workload.height)(rng);
+    }
+    setupWorkload(workload);
+
+    const i32 width = workload.width;
+    const i32 height = workload.height;
+    const i32 size = width * height;
+    std::vector<Individual> individuals = randomIndividuals(rng, workload.populationSize, workload.numTriangles, width, height);
+
+    std::vector<Vec3d> target(size), expected(size), actual(size);
+    rasterizer::premultiply(target.data(), reinterpret_cast<Color const*>(globalCfg.targetImage.getData()), size);
+    f64 const* weights = globalCfg.targetImage.getWeights();
+
+    for (std::size_t e = 0; e < engines.size(); ++e) {
+        std::unique_ptr<FitnessEngine> engine = createEngine(engines[e], options.metric);
+        if (!engine)
+            return false;
+
+        EngineDiff& diff = diffs[e];
+        diff.name = engine->getEngineName();
+
+        std::vector<Individual> work = individuals;
+        engine->evaluate(work);
+
+        for (i32 i = 0; i < static_cast<i32>(work.size()); ++i) {
+            f64 reference = visitFitnessMetric(options.metric, [&](auto policy) {
+                return rasterizer::fitness<decltype(policy)>(expected.data(), target.data(), weights, individuals[i], width, height);
+            });
+            f64 error = std::abs(work[i].getFitness() - reference) / std::max(reference, 1.0);
+            diff.maxRelativeError = std::max(diff.maxRelativeError, error);
+            diff.failures += !(error <= options.tolerance);
+            ++diff.individuals;
+
+            if (!engine->getCanvas(i, actual.data())) {
+                diff.canvas = false;
+                continue;
+            }
+
+            diff.pixels += size;
+            for (i32 xy = 0; xy < size; ++xy) {
+                Vec3d d = actual[xy] - expected[xy];
+                f64 pixelError = std::max({std::abs(d.x), std::abs(d.y), std::abs(d.z)});
+                diff.maxPixelError = std::max(diff.maxPixelError, pixelError);
+                if (pixelError <= options.pixelTolerance)
+                    continue;
+
+                ++diff.mismatchedPixels;
+                if (diff.mismatches.size() < MAX_MISMATCHES)
+                    diff.mismatches.push_back({round, i, width, height, xy % width, xy / width, expected[xy], actual[xy]});
+            }
+        }
+    }
+    return true;
+}
+
+static void serializeVec(JSONSerializerState& state, Vec3d const& v) {
+    state.serialize_array()
+        .add(v.x)
+        .add(v.y)
+        .add(v.z);
+}
+
+int runDiff(Options const& options) {
+    std::vector<std::string> engines = options.engines.empty() ? defaultEngines() : options.engines;
+    std::vector<EngineDiff> diffs(engines.size());
+
+    for (i32 round = 0; round < options.rounds; ++round) {
+        if (!diffRound(options, round, engines, diffs))
+            return 1;
+    }
+
+    bool passed = true;
+    for (EngineDiff const& diff : diffs) {
+        passed &= diff.passed();
+        std::fprintf(stderr, "genalgo_bench: %s: %s, %lld/%lld individuals with a different fitness (max relative error %g)",
+                diff.name.c_str(), diff.passed() ? "OK" : "FAILED", diff.failures, diff.individuals, diff.maxRelativeError);
+        if (diff.canvas)
+            std::fprintf(stderr, ", %lld/%lld mismatched pixels\n", diff.mismatchedPixels, diff.pixels);
+        else
+            std::fprintf(stderr, ", canvases not available\n");
+    }
+
+    Workload const& workload = options.workload;
+    bool written = writeOutput(options.outputFilename, [&](std::ostream& os) {
+        json::serialize(os, [&](JSONSerializerState& state) {
+            state.serialize_object()
+                .add("workload", [&](JSONSerializerState& state) {
+                    state.serialize_object()
+                        .add("seed", workload.seed)
+                        .add("width", workload.width)
+                        .add("height", workload.height)
+                        .add("population", workload.populationSize)
+                        .add("triangles", workload.numTriangles)
+                        .add("metric", std::string_view(fitnessMetricName(options.metric)))
+                        .add("rounds", options.rounds)
+                        .add("tolerance", options.tolerance)
+                        .add("pixel_tolerance", options.pixelTolerance);
+                })
+                .add("engines", [&](JSONSerializerState& state) {
+                    JSONArrayBuilder array = state.serialize_array();
+                    for (EngineDiff const& diff : diffs) {
+                        array.add([&](JSONSerializerState& state) {
+                            JSONObjectBuilder obj = state.serialize_object();
+                            obj.add("name", std::string_view(diff.name))
+                               .add("passed", diff.passed())
+                               .add("individuals", diff.individuals)
+                               .add("failures", diff.failures)
+                               .add("max_relative_error", diff.maxRelativeError)
+                               .add("canvas", diff.canvas);
+                            if (!diff.canvas)
+                                return;
+
+                            obj.add("pixels", diff.pixels)
+                               .add("mismatched_pixels", diff.mismatchedPixels)
+                               .add("max_pixel_error", diff.maxPixelError)
+                               .add("mismatches", [&](JSONSerializerState& state) {
+                                   JSONArrayBuilder mismatches = state.serialize_array();
+                                   for (Mismatch const& m : diff.mismatches) {
+                                       mismatches.add([&](JSONSerializerState& state) {
+                                           state.serialize_object()
+                                               .add("round", m.round)
+                                               .add("individual", m.individual)
+                                               .add("width", m.width)
+                                               .add("height", m.height)
+                                               .add("x", m.x)
+                                               .add("y", m.y)
+                                               .add("expected", [&](JSONSerializerState& state) { serializeVec(state, m.expected); })
+                                               .add("actual", [&](JSONSerializerState& state) { serializeVec(state, m.actual); });
+                                       });
+                                   }
+                               });
+                        });
+                    }
+                })
+                .add("passed", passed);
+        });
+        os << '\n';
+    });
+
+    if (!written)
+        return 1;
+    return passed ? 0 : 1;
+}
+
+}
+
+GA_NAMESPACE_END
@@ -0,0 +1,253 @@
+#include "AppState.hpp"
+#include "Bench.hpp"
+#include "ColorRefit.hpp"
+#include "ErrorGuide.hpp"
+#include "FixedPoint.hpp"
+#include "GlobalConfig.hpp"
+#include "JSONDeserializer.hpp"
+#include "JSONSerializer.hpp"
+#include "MTFitnessEngine.hpp"
+#include "Rasterizer.hpp"
+#include "STFitnessEngine.hpp"
+#include "SpatialIndex.hpp"
+#include "globalRNG.hpp"
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <utility>
+
+GA_NAMESPACE_BEGIN
+
+namespace bench {
+
+int runMicro(Options const& options) {
+    setupWorkload(options.workload);
+    Runner runner(options.workload, options.minTime, options.samples, options.filter);
+    Workload const& workload = runner.getWorkload();
+    const i32 width = workload.width;
+    const i32 height = workload.height;
+    const i32 pixels = width * height;
+
+    Population population = makePopulation(workload);
+    std::vector<Individual>& individuals = population.getIndividuals();
+
+    // Rasterizer, on a single canvas
+    std::vector<Vec3d> src(pixels), dst(pixels);
+    rasterizer::premultiply(src.data(), reinterpret_cast<Color const*>(globalCfg.targetImage.getData()), pixels);
+
+    runner.run("rasterize/clear", [&]() {
+        rasterizer::clear(dst.data(), pixels);
+        doNotOptimize(dst.data());
+    }, pixels, "pixels");
+
+    runner.run("rasterize/individual", [&]() {
+        rasterizer::rasterize(dst.data(), individuals[0], width, height);
+        doNotOptimize(dst.data());
+    }, individuals[0].size(), "triangles");
+
+    // Including the clear, exact
+    rasterizer::FrontToBackState frontToBack;
+    runner.run("rasterize/front-to-back", [&]() {
+        rasterizer::rasterizeFrontToBack(dst.data(), frontToBack, individuals[0], width, height, 0);
+        doNotOptimize(dst.data());
+    }, individuals[0].size(), "triangles");
+
+    // Integer pipeline, on its own canvas
+    std::vector<fixedpoint::Pixel> fixedSrc(pixels), fixedDst(pixels);
+    fixedpoint::toFixed(fixedSrc.data(), src.data(), pixels);
+    runner.run("rasterize/fixed-point", [&]() {
+        fixedpoint::rasterize(fixedDst.data(), individuals[0], width, height);
+        doNotOptimize(fixedDst.data());
+    }, individuals[0].size(), "triangles");
+
+    runner.run("rasterize/score/fixed-point-l2", [&]() {
+        doNotOptimize(fixedpoint::score<metric::L2>(fixedDst.data(), fixedSrc.data(), nullptr, pixels));
+    }, pixels, "pixels");
+
+    // Each metric has its own kernel
+    f64 const* weights = globalCfg.targetImage.getWeights();
+    auto scoreBenchmark = [&](auto policy) {
+        using Metric = decltype(policy);
+        runner.run(std::string("rasterize/score/") + Metric::name, [&]() {
+            doNotOptimize(rasterizer::score<Metric>(dst.data(), src.data(), weights, pixels));
+        }, pixels, "pixels");
+    };
+#define GA_SCORE_BENCHMARK(M) scoreBenchmark(metric::M{});
+    GA_FITNESS_METRICS(GA_SCORE_BENCHMARK)
+#undef GA_SCORE_BENCHMARK
+
+    // Fitness engines, on the whole population
+    {
+        STFitnessEngine<> engine;
+        runner.run("evaluate/ST", [&]() {
+            engine.evaluate(individuals);
+        }, static_cast<f64>(individuals.size()) * pixels, "pixels");
+    }
+    {
+        MTFitnessEngine<> engine;
+        runner.run("evaluate/MT", [&]() {
+            engine.evaluate(individuals);
+        }, static_cast<f64>(individuals.size()) * pixels, "pixels");
+
+        // Error map of the best individual, from the canvas kept by the engine
+        runner.run("errorguide/update", [&]() {
+            errorGuide.update(engine, individuals[0], 0);
+            doNotOptimize(errorGuide.getResidual().data());
+        }, pixels, "pixels");
+
+        runner.run("errorguide/sample", [&]() {
+            Point<i32> point;
+            doNotOptimize(errorGuide.sample(&point));
+            doNotOptimize(point.x);
+        });
+    }
+
+    // Genetic operators
+    if (individuals[0].size() > 0) {
+        Individual individual = individuals[0];
+        ColorRefit refit;
+        i32 index = 0;
+        runner.run("individual/refit", [&]() {
+            index = (index + 1) % individual.size();
+            doNotOptimize(refit.refit(individual, index));
+        });
+    }
+
+    // Spatial index, queried around the triangles of the individual
+    if (individuals[0].size() > 0) {
+        Individual const& individual = individuals[0];
+        std::vector<Triangle> triangles(individual.begin(), individual.end());
+        SpatialIndex index;
+        runner.run("spatialindex/build", [&]() {
+            index.build(triangles, width, height);
+            doNotOptimize(index.size());
+        }, individual.size(), "triangles");
+
+        std::vector<i32> out;
+        i32 i = 0;
+        runner.run("spatialindex/overlapping", [&]() {
+            i = (i + 1) % individual.size();
+            Triangle const& t = individual[i];
+            index.overlapping(std::min({t.a.x, t.b.x, t.c.x}), std::min({t.a.y, t.b.y, t.c.y}),
+                              std::max({t.a.x, t.b.x, t.c.x}), std::max({t.a.y, t.b.y, t.c.y}), out);
+            doNotOptimize(out.data());
+        });
+
+        runner.run("spatialindex/nearest", [&]() {
+            i = (i + 1) % individual.size();
+            Triangle const& t = individual[i];
+            index.nearest((t.a + t.b + t.c) / 3, 8, out, i);
+            doNotOptimize(out.data());
+        });
+    }
+
+    runner.run("population/breed", [&]() {
+        Population next = population.breed();
+        doNotOptimize(next.getIndividuals().data());
+    }, individuals.size(), "individuals");
+
+    {
+        // The individual is reset periodically, so it doesn't drift away from the
+        // workload (the amortized copy is part of the measurement).
+        constexpr i32 RESET_PERIOD = 64;
+        Individual individual = individuals[0];
+        i32 mutations = 0;
+        runner.run("individual/mutate", [&]() {
+            if (++mutations == RESET_PERIOD) {
+                individual = individuals[0];
+                mutations = 0;
+            }
+            doNotOptimize(individual.mutate());
+        });
+    }
+
+    // Same with the spatial index, built once and then kept up to date by the mutations
+    // and crossovers
+    {
+        bool spatialIndex = globalCfg.spatialIndex;
+        globalCfg.spatialIndex = true;
+        Population indexed = population;
+        for (Individual& individual : indexed.getIndividuals())
+            individual.getSpatialIndex();
+
+        runner.run("population/breed/spatial-index", [&]() {
+            Population next = indexed.breed();
+            doNotOptimize(next.getIndividuals().data());
+        }, individuals.size(), "individuals");
+
+        constexpr i32 RESET_PERIOD = 64;
+        Individual individual = indexed.getIndividuals()[0];
+        i32 mutations = 0;
+        runner.run("individual/mutate/spatial-index", [&]() {
+            if (++mutations == RESET_PERIOD) {
+                individual = indexed.getIndividuals()[0];
+                mutations = 0;
+            }
+            doNotOptimize(individual.mutate());
+        });
+        globalCfg.spatialIndex = spatialIndex;
+    }
+
+    for (auto [name, map] : {std::pair{"detail", WeightMap::detail},
+                             std::pair{"sobel", WeightMap::sobel},
+                             std::pair{"variance", WeightMap::variance}}) {
+        runner.run(std::string("image/computeWeights/") + name, [&]() {
+            globalCfg.targetImage.computeWeights(map);
+            doNotOptimize(globalCfg.targetImage.getWeights());
+        }, pixels, "pixels");
+    }
+    globalCfg.targetImage.computeWeights();
+
+    // Checkpoints
+    {
+        i64 generation = 1;
+        u32 seed = workload.seed;
+        AppState state {
+            .population = population,
+            .generation = generation,
+            .seed = seed,
+            .size = {width, height}
+        };
+
+        std::ostringstream checkpoint;
+        json::serialize(checkpoint, state);
+        const std::string json = checkpoint.str();
+
+        runner.run("appstate/serialize", [&]() {
+            std::ostringstream os;
+            json::serialize(os, state);
+            doNotOptimize(os.tellp());
+        }, json.size(), "bytes");
+
+        runner.run("appstate/deserialize", [&]() {
+            Population loaded;
+            i64 loadedGeneration;
+            u32 loadedSeed;
+            AppState loadedState {
+                .population = loaded,
+                .generation = loadedGeneration,
+                .seed = loadedSeed
+            };
+
+            std::istringstream is(json);
+            json::deserialize(is, loadedState);
+            doNotOptimize(loaded.getIndividuals().data());
+        }, json.size(), "bytes");
+    }
+
+    // RNG helpers
+    runner.run("rng/randomBool", [&]() { doNotOptimize(randomBool()); });
+    runner.run("rng/randomU8", [&]() { doNotOptimize(randomU8()); });
+    runner.run("rng/randomU32", [&]() { doNotOptimize(randomU32(1000)); });
+    runner.run("rng/randomI32", [&]() { doNotOptimize(randomI32(-width, width)); });
+    runner.run("rng/randomF64", [&]() { doNotOptimize(randomF64(1.0)); });
+
+    bool written = writeOutput(options.outputFilename, [&](std::ostream& os) {
+        runner.writeJSON(os);
+    });
+    return written ? 0 : 1;
+}
+
+}
+
+GA_NAMESPACE_END
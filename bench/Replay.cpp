@@ -0,0 +1,196 @@
+#include "Bench.hpp"
+
+#include "AppState.hpp"
+#include "FitnessEngine.hpp"
+#include "GlobalConfig.hpp"
+#include "JSONDeserializer.hpp"
+#include "JSONSerializer.hpp"
+#include "Metrics.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <omp.h>
+
+GA_NAMESPACE_BEGIN
+
+namespace bench {
+
+struct EngineReplay {
+    std::string name;
+    Result timing;              // Nanoseconds per evaluation of the whole population
+    std::vector<f64> fitness;   // Of the first evaluation
+    bool deterministic = true;  // All the evaluations produced the same fitness
+
+    // Agreement with the reference (first) engine
+    f64 maxRelativeError = 0;
+    f64 meanRelativeError = 0;
+    f64 rankAgreement = 1;      // Fraction of pairs of individuals ordered the same way
+    bool sameBest = true;
+};
+
+static bool loadCheckpoint(Options const& options, Population& population, i64& generation) {
+    std::ifstream input(options.inputFilename);
+    if (!input) {
+        std::cerr << "genalgo_bench: Failed to open file " << options.inputFilename << std::endl;
+        return false;
+    }
+
+    AppState state {
+        .population = population,
+        .generation = generation,
+        .seed = globalCfg.seed
+    };
+    json::deserialize(input, state);
+
+    if (state.size.x != globalCfg.targetImage.getWidth() || state.size.y != globalCfg.targetImage.getHeight()) {
+        std::cerr << "genalgo_bench: Target image size mismatch, use the image of the checkpoint" << std::endl;
+        return false;
+    }
+    if (population.getIndividuals().empty()) {
+        std::cerr << "genalgo_bench: The checkpoint has no individuals" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+static void compare(EngineReplay& replay, std::vector<f64> const& reference) {
+    const std::size_t n = reference.size();
+    std::vector<f64> const& fitness = replay.fitness;
+
+    f64 totalError = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+        f64 error = std::abs(fitness[i] - reference[i]) / std::max(std::abs(reference[i]), 1e-12);
+        replay.maxRelativeError = std::max(replay.maxRelativeError, error);
+        totalError += error;
+    }
+    replay.meanRelativeError = totalError / n;
+
+    // Engines may use different metrics, but they should still rank individuals alike
+    u64 pairs = 0, concordant = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+        for (std::size_t j = i + 1; j < n; ++j) {
+            auto order = [](f64 a, f64 b) { return (a > b) - (a < b); };
+            ++pairs;
+            concordant += order(fitness[i], fitness[j]) == order(reference[i], reference[j]);
+        }
+    }
+    replay.rankAgreement = pairs ? static_cast<f64>(concordant) / pairs : 1;
+
+    auto best = [](std::vector<f64> const& v) { return std::min_element(v.begin(), v.end()) - v.begin(); };
+    replay.sameBest = best(fitness) == best(reference);
+}
+
+int runReplay(Options const& options) {
+    if (!options.inputFilename || !options.imageFilename) {
+        std::fprintf(stderr, "genalgo_bench: replay needs a checkpoint (--gen-input) and its image (--input)\n");
+        return 1;
+    }
+
+    globalCfg.loadConstants();
+    if (!globalCfg.targetImage.load(options.imageFilename)) {
+        std::fprintf(stderr, "genalgo_bench: Failed to load image: %s\n", options.imageFilename);
+        return 1;
+    }
+
+    Population population;
+    i64 generation = 0;
+    if (!loadCheckpoint(options, population, generation))
+        return 1;
+
+    // Engines are sized for the population of the checkpoint
+    std::vector<Individual> const& individuals = population.getIndividuals();
+    globalCfg.populationSize = static_cast<i32>(individuals.size());
+
+    std::vector<std::string> engines = options.engines.empty() ? defaultEngines() : options.engines;
+
+    const f64 pixels = static_cast<f64>(globalCfg.targetImage.getWidth()) * globalCfg.targetImage.getHeight();
+    std::vector<EngineReplay> replays;
+    for (std::string const& name : engines) {
+        std::unique_ptr<FitnessEngine> engine = createEngine(name, options.metric);
+        if (!engine)
+            return 1;
+
+        EngineReplay& replay = replays.emplace_back();
+        replay.name = engine->getEngineName();
+
+        // The first evaluation is a warm up, it's only used to check determinism
+        std::vector<Individual> work = individuals;
+        engine->evaluate(work);
+        for (Individual const& i : work)
+            replay.fitness.push_back(i.getFitness());
+
+        std::vector<f64> times;
+        for (i32 it = 0; it < options.iterations; ++it) {
+            auto start = std::chrono::steady_clock::now();
+            engine->evaluate(work);
+            times.push_back(std::chrono::duration<f64, std::nano>(std::chrono::steady_clock::now() - start).count());
+
+            for (std::size_t i = 0; i < work.size(); ++i)
+                replay.deterministic &= work[i].getFitness() == replay.fitness[i];
+        }
+
+        replay.timing.name = replay.name;
+        replay.timing.iterations = 1;
+        replay.timing.itemsPerOp = pixels * work.size();
+        replay.timing.itemName = "pixels";
+        replay.timing.setSamples(times);
+
+        compare(replay, replays.front().fitness);
+    }
+
+    PopulationStats stats = PopulationStats::compute(population);
+    bool written = writeOutput(options.outputFilename, [&](std::ostream& os) {
+        json::serialize(os, [&](JSONSerializerState& state) {
+            state.serialize_object()
+                .add("checkpoint", [&](JSONSerializerState& state) {
+                    state.serialize_object()
+                        .add("generation", generation)
+                        .add("width", globalCfg.targetImage.getWidth())
+                        .add("height", globalCfg.targetImage.getHeight())
+                        .add("population", globalCfg.populationSize)
+                        .add("metric", std::string_view(fitnessMetricName(options.metric)))
+                        .add("min_triangles", stats.minTriangles)
+                        .add("mean_triangles", stats.meanTriangles)
+                        .add("max_triangles", stats.maxTriangles)
+                        .add("threads", omp_get_max_threads());
+                })
+                .add("reference", std::string_view(replays.front().name))
+                .add("engines", [&](JSONSerializerState& state) {
+                    JSONArrayBuilder array = state.serialize_array();
+                    for (EngineReplay const& replay : replays) {
+                        Result const& t = replay.timing;
+                        array.add([&](JSONSerializerState& state) {
+                            state.serialize_object()
+                                .add("name", std::string_view(replay.name))
+                                .add("iterations", t.samples)
+                                .add("median_ms", 1e-6 * t.median)
+                                .add("min_ms", 1e-6 * t.min)
+                                .add("mean_ms", 1e-6 * t.mean)
+                                .add("stddev_ms", 1e-6 * t.stddev)
+                                .add("individuals_per_second", 1e9 * replay.fitness.size() / t.median)
+                                .add("mpixels_per_second", 1e3 * t.itemsPerOp / t.median)
+                                .add("deterministic", replay.deterministic)
+                                .add("max_relative_error", replay.maxRelativeError)
+                                .add("mean_relative_error", replay.meanRelativeError)
+                                .add("rank_agreement", replay.rankAgreement)
+                                .add("same_best", replay.sameBest);
+                        });
+                    }
+                });
+        });
+        os << '\n';
+    });
+    return written ? 0 : 1;
+}
+
+}
+
+GA_NAMESPACE_END
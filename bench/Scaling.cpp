@@ -0,0 +1,195 @@
+#include "Bench.hpp"
+
+#include "FitnessEngine.hpp"
+#include "GlobalConfig.hpp"
+#include "Vec.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+
+#include <omp.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+GA_NAMESPACE_BEGIN
+
+namespace bench {
+
+// Resets the peak RSS of the process (VmHWM), so each configuration reports its own peak.
+// Returns false if the kernel doesn't support it.
+static bool resetPeakRSS() {
+    std::ofstream clearRefs("/proc/self/clear_refs");
+    clearRefs << "5";
+    return static_cast<bool>(clearRefs.flush());
+}
+
+// Peak RSS in bytes
+static u64 peakRSS() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.rfind("VmHWM:", 0) == 0)
+            return std::stoull(line.substr(6)) * 1024;
+    }
+
+    // Peak of the whole process, it can't be reset
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<u64>(usage.ru_maxrss) * 1024;
+}
+
+static u64 physicalMemory() {
+    return static_cast<u64>(sysconf(_SC_PHYS_PAGES)) * sysconf(_SC_PAGE_SIZE);
+}
+
+// Pixels blended by the rasterizer, estimated from the area of the triangles
+// (the triangles of a population are always inside the target).
+static f64 blendedPixels(Population const& population) {
+    f64 pixels = 0;
+    for (Individual const& individual : population.getIndividuals()) {
+        for (Triangle const& t : individual)
+            pixels += 0.5 * t.area(); // area() is twice the area
+    }
+    return pixels;
+}
+
+struct ScalingResult {
+    i64 generations = 0;
+    f64 seconds = 0;
+    f64 blended = 0;
+    u64 peakRSS = 0;
+};
+
+static std::optional<ScalingResult> runConfiguration(Options const& options, Workload const& workload) {
+    using Clock = std::chrono::steady_clock;
+
+    setupWorkload(workload);
+    Population population = makePopulation(workload);
+    std::unique_ptr<FitnessEngine> engine = createFitnessEngine(options.engine, options.metric);
+    if (!engine) {
+        std::fprintf(stderr, "genalgo_bench: Unknown fitness engine: %s\n", options.engine);
+        return std::nullopt;
+    }
+
+    // Same work as a generation of genalgo --no-render: evaluation and breeding.
+    // The first generation is a warm up and isn't measured.
+    auto generation = [&](ScalingResult* result) {
+        auto start = Clock::now();
+        population.evaluate(*engine);
+        auto evaluated = Clock::now();
+
+        if (result)
+            result->blended += blendedPixels(population);
+
+        auto breedStart = Clock::now();
+        population = population.breed();
+        auto end = Clock::now();
+
+        if (result) {
+            result->seconds += std::chrono::duration<f64>((evaluated - start) + (end - breedStart)).count();
+            ++result->generations;
+        }
+    };
+
+    generation(nullptr);
+
+    ScalingResult result;
+    constexpr i64 MIN_GENERATIONS = 3;
+    while (options.generations > 0
+            ? result.generations < options.generations
+            : result.seconds < options.minTime || result.generations < MIN_GENERATIONS) {
+        generation(&result);
+    }
+
+    result.peakRSS = peakRSS();
+    return result;
+}
+
+int runScaling(Options const& options) {
+    std::vector<i32> threads = options.threads;
+    if (threads.empty()) {
+        i32 maxThreads = omp_get_max_threads();
+        for (i32 t = 1; t < maxThreads; t *= 2)
+            threads.push_back(t);
+        threads.push_back(maxThreads);
+    }
+    std::sort(threads.begin(), threads.end());
+    threads.erase(std::unique(threads.begin(), threads.end()), threads.end());
+
+    std::ofstream file;
+    if (options.outputFilename) {
+        file.open(options.outputFilename);
+        if (!file) {
+            std::cerr << "genalgo_bench: Failed to open file " << options.outputFilename << std::endl;
+            return 1;
+        }
+    }
+    std::ostream& os = options.outputFilename ? file : std::cout;
+
+    if (!resetPeakRSS())
+        std::fprintf(stderr, "genalgo_bench: Warning: Peak RSS can't be reset, it's the peak of the whole run\n");
+
+    // Configurations that would need more than this are skipped
+    const u64 memoryLimit = physicalMemory() / 10 * 8;
+
+    os << "engine,threads,width,height,population,triangles,generations,seconds,"
+          "generations_per_second,mpixels_evaluated_per_second,mpixels_blended_per_second,"
+          "peak_rss_mib,parallel_efficiency\n";
+
+    for (i32 size : options.sizes) {
+        for (i32 populationSize : options.populations) {
+            for (i32 numTriangles : options.triangleCounts) {
+                Workload workload = options.workload;
+                workload.width = size;
+                workload.height = size;
+                workload.populationSize = populationSize;
+                workload.numTriangles = numTriangles;
+
+                // The MT engine keeps a canvas per individual
+                u64 pixels = static_cast<u64>(size) * size;
+                u64 memory = pixels * (populationSize + 2) * sizeof(Vec3d);
+                if (memory > memoryLimit) {
+                    std::fprintf(stderr, "genalgo_bench: Skipping %dx%d, population = %d: needs %llu MiB\n",
+                            size, size, populationSize, memory >> 20);
+                    continue;
+                }
+
+                // Efficiency is relative to the smallest number of threads
+                f64 baseline = 0;
+                for (i32 t : threads) {
+                    omp_set_num_threads(t);
+                    resetPeakRSS();
+                    std::optional<ScalingResult> run = runConfiguration(options, workload);
+                    if (!run)
+                        return 1;
+                    ScalingResult const& result = *run;
+
+                    f64 gps = result.generations / result.seconds;
+                    if (baseline == 0)
+                        baseline = gps / threads.front();
+                    f64 efficiency = gps / (baseline * t);
+
+                    char buffer[512];
+                    std::snprintf(buffer, sizeof(buffer), "%s,%d,%d,%d,%d,%d,%lld,%.4f,%.4f,%.3f,%.3f,%.1f,%.4f\n",
+                            options.engine, t, size, size, populationSize, numTriangles,
+                            result.generations, result.seconds, gps,
+                            1e-6 * pixels * populationSize * gps,
+                            1e-6 * result.blended / result.seconds,
+                            result.peakRSS / (1024.0 * 1024.0), efficiency);
+                    os << buffer << std::flush;
+                }
+            }
+        }
+    }
+
+    return os ? 0 : 1;
+}
+
+}
+
+GA_NAMESPACE_END
@@ -0,0 +1,265 @@
+#include "Bench.hpp"
+
+#include "GlobalConfig.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <limits>
+#include <string>
+#include <vector>
+
+GA_NAMESPACE_BEGIN
+
+namespace bench {
+
+static bool print_usage(bool in_help = false) {
+    FILE* out = in_help ? stdout : stderr;
+    std::fprintf(out, "Usage: genalgo_bench [command] [options]\n");
+    std::fprintf(out, "Commands:\n");
+    std::fprintf(out, "  micro                    Microbenchmarks of the hot paths (default)\n");
+    std::fprintf(out, "  scaling                  Generations/sec of every combination of threads, sizes, populations\n");
+    std::fprintf(out, "                           and triangle counts (CSV)\n");
+    std::fprintf(out, "  replay                   Re-evaluates a checkpoint with every engine: timing and\n");
+    std::fprintf(out, "                           agreement of the fitness between engines\n");
+    std::fprintf(out, "  diff                     Checks that engines compute the reference fitness and canvases on\n");
+    std::fprintf(out, "                           random individuals, fails if they don't\n");
+    std::fprintf(out, "Options:\n");
+    std::fprintf(out, "  -o, --output <file>      Output file (default = stdout)\n");
+    std::fprintf(out, "  --filter <text>          Only run benchmarks whose name contains text\n");
+    std::fprintf(out, "  --min-time <seconds>     Minimum time of each benchmark (default = 0.5)\n");
+    std::fprintf(out, "  --samples <n>            Number of timed samples (default = 10)\n");
+    std::fprintf(out, "  -s, --seed <seed>        Seed of the synthetic workload (default = 1)\n");
+    std::fprintf(out, "  --size <n>               Width and height of the synthetic target (default = 256)\n");
+    std::fprintf(out, "  --population <n>         Number of individuals (default = 50)\n");
+    std::fprintf(out, "  --triangles <n>          Number of triangles in each individual (default = 100)\n");
+    std::fprintf(out, "  -m, --metric <metric>    Error metric of the engines of scaling, replay and diff:\n");
+    std::fprintf(out, "                           l2, weighted-l2, l1, luma or pow-l2 (default = l2)\n");
+    std::fprintf(out, "  --front-to-back <t>      Composite front to back in the CPU engines, t in [0, 1), as in genalgo\n");
+    std::fprintf(out, "  --fixed-point            Blend and score in integers in the CPU engines, as in genalgo\n");
+    std::fprintf(out, "  --no-batch               Evaluate small targets one individual at a time, as in genalgo\n");
+    std::fprintf(out, "Scaling options:\n");
+    std::fprintf(out, "  -e, --engine <engine>    Fitness engine to use (default = MT)\n");
+    std::fprintf(out, "  --generations <n>        Generations of each configuration (default = run for --min-time)\n");
+    std::fprintf(out, "  --threads <list>         Thread counts, e.g. 1,2,4 (default = powers of two up to the cores)\n");
+    std::fprintf(out, "  --sizes <list>           Target sizes (default = 256,512,1024,2048,4096)\n");
+    std::fprintf(out, "  --populations <list>     Population sizes (default = 50,200)\n");
+    std::fprintf(out, "  --triangle-counts <list> Triangles in each individual (default = 50,200)\n");
+    std::fprintf(out, "Replay options:\n");
+    std::fprintf(out, "  -i, --input <image>      Target image of the checkpoint\n");
+    std::fprintf(out, "  -gi, --gen-input <file>  Checkpoint to evaluate (written by genalgo --gen-output)\n");
+    std::fprintf(out, "  --engines <list>         Engines to compare, the first one is the reference\n");
+    std::fprintf(out, "                           (default = ST,MT and CUDA if there is a device)\n");
+    std::fprintf(out, "  --iterations <n>         Evaluations with each engine (default = 10)\n");
+    std::fprintf(out, "Diff options (also --engines, --seed, --size, --population and --triangles):\n");
+    std::fprintf(out, "  --rounds <n>             Random targets and populations to check (default = 20)\n");
+    std::fprintf(out, "  --tolerance <x>          Maximum relative error of the fitness (default = 1e-4)\n");
+    std::fprintf(out, "  --pixel-tolerance <x>    Maximum error of a channel of a pixel (default = 0.5)\n");
+    std::fprintf(out, "  -h, --help               Display this information\n");
+    return false;
+}
+
+static bool to_i32(const char* str, i32* out, i32 min) {
+    char* end;
+    long val = std::strtol(str, &end, 10);
+    if (*end != '\0' || end == str || val < min || val > std::numeric_limits<i32>::max())
+        return false;
+    *out = static_cast<i32>(val);
+    return true;
+}
+
+// Non-negative number
+static bool to_f64(const char* str, f64* out) {
+    char* end;
+    f64 val = std::strtod(str, &end);
+    if (*end != '\0' || end == str || !(val >= 0))
+        return false;
+    *out = val;
+    return true;
+}
+
+// Comma-separated list of positive numbers
+static bool to_i32_list(const char* str, std::vector<i32>* out) {
+    std::vector<i32> values;
+    std::string list(str);
+    std::size_t start = 0;
+    while (start <= list.size()) {
+        std::size_t end = std::min(list.find(',', start), list.size());
+        i32 value;
+        if (!to_i32(list.substr(start, end - start).c_str(), &value, 1))
+            return false;
+        values.push_back(value);
+        start = end + 1;
+    }
+    *out = std::move(values);
+    return true;
+}
+
+static void to_string_list(const char* str, std::vector<std::string>* out) {
+    out->clear();
+    std::string list(str);
+    std::size_t start = 0;
+    while (start <= list.size()) {
+        std::size_t end = std::min(list.find(',', start), list.size());
+        out->push_back(list.substr(start, end - start));
+        start = end + 1;
+    }
+}
+
+static bool parseOptions(int argc, char* argv[], Options& options) {
+    i32 first = 1;
+    if (argc > 1 && argv[1][0] != '-') {
+        options.command = argv[1];
+        first = 2;
+    }
+
+    for (i32 i = first; i < argc; ++i) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        auto is = [&](const char* shortName, const char* longName) {
+            return (shortName && std::strcmp(arg, shortName) == 0) || std::strcmp(arg, longName) == 0;
+        };
+        auto needsValue = [&]() {
+            if (!value) {
+                std::fprintf(stderr, "genalgo_bench: Missing value after %s\n", arg);
+                return false;
+            }
+            ++i;
+            return true;
+        };
+        auto invalid = [&]() {
+            std::fprintf(stderr, "genalgo_bench: Invalid value for %s: %s\n", arg, value);
+            return print_usage();
+        };
+
+        if (is("-h", "--help")) {
+            return print_usage(true);
+        } else if (is("-o", "--output")) {
+            if (!needsValue()) return print_usage();
+            options.outputFilename = value;
+        } else if (is(nullptr, "--filter")) {
+            if (!needsValue()) return print_usage();
+            options.filter = value;
+        } else if (is(nullptr, "--min-time")) {
+            if (!needsValue()) return print_usage();
+            if (!to_f64(value, &options.minTime) || options.minTime <= 0) return invalid();
+        } else if (is(nullptr, "--samples")) {
+            if (!needsValue()) return print_usage();
+            if (!to_i32(value, &options.samples, 1)) return invalid();
+        } else if (is("-s", "--seed")) {
+            if (!needsValue()) return print_usage();
+            char* end;
+            unsigned long seed = std::strtoul(value, &end, 10);
+            if (*end != '\0' || seed > std::numeric_limits<u32>::max())
+                return invalid();
+            options.workload.seed = static_cast<u32>(seed);
+        } else if (is(nullptr, "--size")) {
+            if (!needsValue()) return print_usage();
+            if (!to_i32(value, &options.workload.width, 1)) return invalid();
+            options.workload.height = options.workload.width;
+        } else if (is(nullptr, "--population")) {
+            if (!needsValue()) return print_usage();
+            if (!to_i32(value, &options.workload.populationSize, 2)) return invalid();
+        } else if (is(nullptr, "--triangles")) {
+            if (!needsValue()) return print_usage();
+            if (!to_i32(value, &options.workload.numTriangles, 1)) return invalid();
+        } else if (is("-m", "--metric")) {
+            if (!needsValue()) return print_usage();
+            if (!parseFitnessMetric(value, &options.metric)) return invalid();
+        } else if (is(nullptr, "--front-to-back")) {
+            if (!needsValue()) return print_usage();
+            if (!to_f64(value, &options.minTransmittance) || !(options.minTransmittance < 1)) return invalid();
+            options.frontToBack = true;
+        } else if (is(nullptr, "--fixed-point")) {
+            options.fixedPoint = true;
+        } else if (is(nullptr, "--no-batch")) {
+            options.batchDisabled = true;
+        } else if (is("-e", "--engine")) {
+            if (!needsValue()) return print_usage();
+            options.engine = value;
+        } else if (is(nullptr, "--generations")) {
+            if (!needsValue()) return print_usage();
+            i32 generations;
+            if (!to_i32(value, &generations, 1)) return invalid();
+            options.generations = generations;
+        } else if (is(nullptr, "--threads")) {
+            if (!needsValue()) return print_usage();
+            if (!to_i32_list(value, &options.threads)) return invalid();
+        } else if (is(nullptr, "--sizes")) {
+            if (!needsValue()) return print_usage();
+            if (!to_i32_list(value, &options.sizes)) return invalid();
+        } else if (is(nullptr, "--populations")) {
+            if (!needsValue()) return print_usage();
+            if (!to_i32_list(value, &options.populations)) return invalid();
+        } else if (is(nullptr, "--triangle-counts")) {
+            if (!needsValue()) return print_usage();
+            if (!to_i32_list(value, &options.triangleCounts)) return invalid();
+        } else if (is("-i", "--input")) {
+            if (!needsValue()) return print_usage();
+            options.imageFilename = value;
+        } else if (is("-gi", "--gen-input")) {
+            if (!needsValue()) return print_usage();
+            options.inputFilename = value;
+        } else if (is(nullptr, "--engines")) {
+            if (!needsValue()) return print_usage();
+            to_string_list(value, &options.engines);
+        } else if (is(nullptr, "--iterations")) {
+            if (!needsValue()) return print_usage();
+            if (!to_i32(value, &options.iterations, 1)) return invalid();
+        } else if (is(nullptr, "--rounds")) {
+            if (!needsValue()) return print_usage();
+            if (!to_i32(value, &options.rounds, 1)) return invalid();
+        } else if (is(nullptr, "--tolerance")) {
+            if (!needsValue()) return print_usage();
+            if (!to_f64(value, &options.tolerance)) return invalid();
+        } else if (is(nullptr, "--pixel-tolerance")) {
+            if (!needsValue()) return print_usage();
+            if (!to_f64(value, &options.pixelTolerance)) return invalid();
+        } else {
+            std::fprintf(stderr, "genalgo_bench: Unknown option: %s\n", arg);
+            return print_usage();
+        }
+    }
+
+    // Same checks as genalgo, the engines would silently ignore front-to-back
+    if (options.fixedPoint && options.frontToBack) {
+        std::fprintf(stderr, "genalgo_bench: --fixed-point and --front-to-back can't be combined\n");
+        return print_usage();
+    }
+    return true;
+}
+
+static int main(int argc, char* argv[]) {
+    Options options;
+    if (!parseOptions(argc, argv, options))
+        return 1;
+
+    // Not reset by setupWorkload
+    globalCfg.frontToBack = options.frontToBack;
+    globalCfg.minTransmittance = options.minTransmittance;
+    globalCfg.fixedPoint = options.fixedPoint;
+    globalCfg.batchDisabled = options.batchDisabled;
+
+    if (std::strcmp(options.command, "micro") == 0) {
+        return runMicro(options);
+    } else if (std::strcmp(options.command, "scaling") == 0) {
+        return runScaling(options);
+    } else if (std::strcmp(options.command, "replay") == 0) {
+        return runReplay(options);
+    } else if (std::strcmp(options.command, "diff") == 0) {
+        return runDiff(options);
+    } else {
+        std::fprintf(stderr, "genalgo_bench: Unknown command: %s\n", options.command);
+        print_usage();
+        return 1;
+    }
+}
+
+}
+
+GA_NAMESPACE_END
+
+// Entry point
+int main(int argc, char* argv[]) {
+    return genalgo::bench::main(argc, argv);
+}
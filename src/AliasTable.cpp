@@ -0,0 +1,54 @@
+#include "AliasTable.hpp"
+
+#include <cmath>
+
+GA_NAMESPACE_BEGIN
+
+bool AliasTable::build(f64 const weights[], i32 n) {
+    clear();
+
+    f64 total = 0;
+    for (i32 i = 0; i < n; ++i)
+        total += weights[i];
+    if (n <= 0 || !(total > 0) || !std::isfinite(total))
+        return false;
+
+    prob.resize(n);
+    alias.resize(n);
+    small.clear();
+    large.clear();
+
+    // Scaled so that the mean is 1, each column is then filled up to 1 by a large one
+    const f64 scale = n / total;
+    for (i32 i = 0; i < n; ++i) {
+        prob[i] = weights[i] * scale;
+        alias[i] = i;
+        (prob[i] < 1.0 ? small : large).push_back(i);
+    }
+
+    while (!small.empty() && !large.empty()) {
+        i32 s = small.back();
+        small.pop_back();
+        i32 l = large.back();
+
+        alias[s] = l;
+        prob[l] -= 1.0 - prob[s];
+        if (prob[l] < 1.0) {
+            large.pop_back();
+            small.push_back(l);
+        }
+    }
+
+    // Only rounding errors are left
+    for (i32 i : small)
+        prob[i] = 1.0;
+    for (i32 i : large)
+        prob[i] = 1.0;
+
+    threshold.resize(n);
+    for (i32 i = 0; i < n; ++i)
+        threshold[i] = static_cast<u64>(std::ldexp(prob[i], 32));
+    return true;
+}
+
+GA_NAMESPACE_END
@@ -0,0 +1,56 @@
+#ifndef GENALGO_ALIASTABLE_HPP
+#define GENALGO_ALIASTABLE_HPP
+
+#include "base.hpp"
+#include <vector>
+
+GA_NAMESPACE_BEGIN
+
+// Walker's alias method (Vose's variant): samples an index from a discrete distribution
+// in O(1), after an O(n) build.
+class AliasTable {
+public:
+    AliasTable() noexcept = default;
+
+    // Builds the table of the non-negative weights. Returns false, and leaves the table
+    // empty, if they don't sum to a positive finite number.
+    bool build(f64 const weights[], i32 n);
+
+    // Index i with probability weights[i] / sum(weights), from u uniform in [0, 1)
+    i32 sample(f64 u) const noexcept {
+        const i32 n = static_cast<i32>(prob.size());
+        f64 x = u * n;
+        i32 i = static_cast<i32>(x);
+        if (i >= n)
+            i = n - 1;
+        return x - i < prob[i] ? i : alias[i];
+    }
+
+    // Same, from a single uniform 32-bit draw: the high bits of bits * n pick the column,
+    // the low bits are the uniform position within it
+    i32 sample(u32 bits) const noexcept {
+        u64 x = static_cast<u64>(bits) * threshold.size();
+        i32 i = static_cast<i32>(x >> 32);
+        return (x & 0xFFFFFFFF) < threshold[i] ? i : alias[i];
+    }
+
+    bool empty() const noexcept { return prob.empty(); }
+    i32 size() const noexcept { return static_cast<i32>(prob.size()); }
+
+    void clear() noexcept {
+        prob.clear();
+        threshold.clear();
+        alias.clear();
+    }
+private:
+    std::vector<f64> prob;
+    std::vector<u64> threshold;     // prob * 2^32, so that 1 is never reached by 32 bits
+    std::vector<i32> alias;
+
+    // Scratch space of build, kept to avoid reallocations
+    std::vector<i32> small, large;
+};
+
+GA_NAMESPACE_END
+
+#endif // GENALGO_ALIASTABLE_HPP
@@ -0,0 +1,118 @@
+#include "CPURenderer.hpp"
+
+#include "GlobalConfig.hpp"
+#include "Rasterizer.hpp"
+#include "Vec.hpp"
+#include <algorithm>
+#include <cmath>
+
+#include <omp.h>
+
+GA_NAMESPACE_BEGIN
+
+// Size of the tiles (in output pixels) that are rendered by each thread
+static constexpr i32 RENDER_TILE_SIZE = 32;
+
+static bool pointInTriangle(Vec2d p, Vec2d a, Vec2d b, Vec2d c) {
+    auto sign = [](Vec2d p1, Vec2d p2, Vec2d p3) {
+        return (p1.x - p3.x) * (p2.y - p3.y) - (p2.x - p3.x) * (p1.y - p3.y);
+    };
+
+    bool b1, b2, b3;
+
+    b1 = sign(p, a, b) < 0;
+    b2 = sign(p, b, c) < 0;
+    b3 = sign(p, c, a) < 0;
+
+    return ((b1 == b2) && (b2 == b3));
+}
+
+CPURenderer::CPURenderer(i32 scale, i32 supersample)
+    : scale(std::max(1, scale)),
+      supersample(std::max(1, supersample))
+{
+    width = globalCfg.targetImage.getWidth() * this->scale;
+    height = globalCfg.targetImage.getHeight() * this->scale;
+}
+
+void CPURenderer::render(Individual const& individual, std::vector<Color>& out) const {
+    out.resize(static_cast<std::size_t>(width) * height);
+
+    // Samples are placed in a regular grid of (scale * supersample) samples per target pixel.
+    // The sample k is located at target coordinate (k + 0.5) / samplesPerPixel - 0.5, so
+    // with scale = supersample = 1 each pixel is sampled exactly where the fitness engines do.
+    const i32 ss = supersample;
+    const f64 samplesPerPixel = static_cast<f64>(scale) * ss;
+    auto toSample = [&](f64 coord) {
+        return (coord + 0.5) * samplesPerPixel - 0.5;
+    };
+    auto fromSample = [&](i32 k) {
+        return (k + 0.5) / samplesPerPixel - 0.5;
+    };
+
+    const i32 tilesX = (width + RENDER_TILE_SIZE - 1) / RENDER_TILE_SIZE;
+    const i32 tilesY = (height + RENDER_TILE_SIZE - 1) / RENDER_TILE_SIZE;
+
+    #pragma omp parallel
+    {
+        std::vector<Vec3d> samples(static_cast<std::size_t>(RENDER_TILE_SIZE * ss) * (RENDER_TILE_SIZE * ss));
+
+        #pragma omp for schedule(dynamic)
+        for (i32 tile = 0; tile < tilesX * tilesY; ++tile) {
+            i32 x0 = (tile % tilesX) * RENDER_TILE_SIZE;
+            i32 y0 = (tile / tilesX) * RENDER_TILE_SIZE;
+            i32 x1 = std::min(x0 + RENDER_TILE_SIZE, width);
+            i32 y1 = std::min(y0 + RENDER_TILE_SIZE, height);
+
+            // Sample range covered by the tile: [sx0, sx1) x [sy0, sy1)
+            i32 sx0 = x0 * ss, sx1 = x1 * ss;
+            i32 sy0 = y0 * ss, sy1 = y1 * ss;
+            i32 stride = sx1 - sx0;
+
+            std::fill(samples.begin(), samples.end(), Vec3d{0, 0, 0});
+
+            for (Triangle const& t : individual) {
+                Vec2d a(t.a.x, t.a.y);
+                Vec2d b(t.b.x, t.b.y);
+                Vec2d c(t.c.x, t.c.y);
+                Vec3d color = rasterizer::fromColor(t.color);
+
+                i32 minX = std::max(sx0, static_cast<i32>(std::ceil(toSample(std::min({a.x, b.x, c.x})))));
+                i32 minY = std::max(sy0, static_cast<i32>(std::ceil(toSample(std::min({a.y, b.y, c.y})))));
+                i32 maxX = std::min(sx1 - 1, static_cast<i32>(std::floor(toSample(std::max({a.x, b.x, c.x})))));
+                i32 maxY = std::min(sy1 - 1, static_cast<i32>(std::floor(toSample(std::max({a.y, b.y, c.y})))));
+
+                for (i32 y = minY; y <= maxY; ++y) {
+                    f64 py = fromSample(y);
+                    for (i32 x = minX; x <= maxX; ++x) {
+                        if (pointInTriangle({fromSample(x), py}, a, b, c)) {
+                            Vec3d& dst = samples[(y - sy0) * stride + (x - sx0)];
+                            dst = rasterizer::blend(dst, color, t.color.a);
+                        }
+                    }
+                }
+            }
+
+            // Resolve the samples
+            const f64 invSamples = 1.0 / (ss * ss);
+            for (i32 y = y0; y < y1; ++y) {
+                for (i32 x = x0; x < x1; ++x) {
+                    Vec3d sum{0, 0, 0};
+                    for (i32 dy = 0; dy < ss; ++dy) {
+                        for (i32 dx = 0; dx < ss; ++dx) {
+                            sum += samples[((y - y0) * ss + dy) * stride + (x - x0) * ss + dx];
+                        }
+                    }
+                    sum *= invSamples;
+
+                    auto toU8 = [](f64 v) {
+                        return static_cast<u8>(std::clamp(std::lround(v), 0l, 255l));
+                    };
+                    out[static_cast<std::size_t>(y) * width + x] = Color{toU8(sum.r), toU8(sum.g), toU8(sum.b), 255};
+                }
+            }
+        }
+    }
+}
+
+GA_NAMESPACE_END
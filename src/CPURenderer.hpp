@@ -0,0 +1,36 @@
+#ifndef GENALGO_CPURENDERER_HPP
+#define GENALGO_CPURENDERER_HPP
+
+#include "base.hpp"
+#include "Color.hpp"
+#include "Individual.hpp"
+#include <vector>
+
+GA_NAMESPACE_BEGIN
+
+// Headless, multi-threaded rasterizer for individuals.
+// It doesn't need a display, so it can be used to export the result on machines
+// without an X server.
+class CPURenderer {
+public:
+    // scale: Number of output pixels per target pixel (same meaning as svgScale)
+    // supersample: Number of samples per axis for each output pixel
+    CPURenderer(i32 scale, i32 supersample);
+
+    i32 getWidth() const noexcept { return width; }
+    i32 getHeight() const noexcept { return height; }
+
+    // Renders the individual over a black background, the output is opaque RGBA
+    // and has getWidth() * getHeight() pixels.
+    void render(Individual const& individual, std::vector<Color>& out) const;
+
+private:
+    i32 scale;
+    i32 supersample;
+    i32 width;
+    i32 height;
+};
+
+GA_NAMESPACE_END
+
+#endif // GENALGO_CPURENDERER_HPP
@@ -0,0 +1,118 @@
+#include "ColorRefit.hpp"
+
+#include "GlobalConfig.hpp"
+#include "Rasterizer.hpp"
+#include <algorithm>
+#include <cmath>
+
+GA_NAMESPACE_BEGIN
+
+bool ColorRefit::refit(Individual& individual, i32 index) {
+    const i32 width = globalCfg.targetImage.getWidth();
+    const i32 height = globalCfg.targetImage.getHeight();
+    Vec3d const* target = globalCfg.targetImage.getPremultiplied();
+    f64 const* weights = globalCfg.targetImage.getWeights();
+    const bool weighted = visitFitnessMetric(globalCfg.fitnessMetric, [](auto policy) {
+        return decltype(policy)::weighted;
+    });
+
+    // Through a const reference, the non-const accessors would invalidate the spatial index
+    Individual const& triangles = individual;
+    Triangle const& triangle = triangles[index];
+    rasterizer::BoundingBox box = rasterizer::boundingBox(triangle, width, height);
+
+    // Same coverage as the rasterizer
+    pixels.clear();
+    for (i32 y = box.minY; y <= box.maxY; ++y) {
+        for (i32 x = box.minX; x <= box.maxX; ++x) {
+            if (rasterizer::pointInTriangle({x, y}, triangle.a, triangle.b, triangle.c))
+                pixels.push_back(y * width + x);
+        }
+    }
+    if (pixels.empty())
+        return false;
+
+    const std::size_t count = pixels.size();
+    below.assign(count, Vec3d{0, 0, 0});
+    above.assign(count, Vec3d{0, 0, 0});
+    transmittance.assign(count, 1.0);
+
+    // The triangles that may overlap it, in drawing order
+    if (globalCfg.spatialIndex) {
+        individual.getSpatialIndex().overlapping(box.minX, box.minY, box.maxX, box.maxY, candidates);
+    } else {
+        candidates.clear();
+        for (i32 j = 0; j < triangles.size(); ++j) {
+            if (rasterizer::overlaps(box, rasterizer::boundingBox(triangles[j], width, height)))
+                candidates.push_back(j);
+        }
+    }
+
+    for (i32 j : candidates) {
+        Triangle const& t = triangles[j];
+        if (j == index)
+            continue;
+
+        Vec3d color = rasterizer::fromColor(t.color);
+        f64 alpha = t.color.a / 255.0;
+        for (std::size_t i = 0; i < count; ++i) {
+            Point<i32> p {pixels[i] % width, pixels[i] / width};
+            if (!rasterizer::pointInTriangle(p, t.a, t.b, t.c))
+                continue;
+
+            if (j < index) {
+                below[i] = rasterizer::blend(below[i], color, t.color.a);
+            } else {
+                above[i] = rasterizer::blend(above[i], color, t.color.a);
+                transmittance[i] *= 1.0 - alpha;
+            }
+        }
+    }
+
+    const f64 alpha = triangle.color.a / 255.0;
+    auto rest = [&](std::size_t i) {
+        return ((1.0 - alpha) * transmittance[i]) * below[i] + above[i];
+    };
+
+    Vec3d numerator {0, 0, 0};
+    f64 denominator = 0;
+    for (std::size_t i = 0; i < count; ++i) {
+        f64 w = alpha * transmittance[i];
+        f64 scale = weighted ? 1.0 + weights[pixels[i]] : 1.0;
+        numerator += (scale * w) * (target[pixels[i]] - rest(i));
+        denominator += scale * w * w;
+    }
+    if (denominator <= 0)
+        return false;
+
+    auto channel = [&](f64 value) {
+        return static_cast<u8>(std::clamp<f64>(std::round(value / denominator), 0, 255));
+    };
+    Color color = triangle.color;
+    color.r = channel(numerator.x);
+    color.g = channel(numerator.y);
+    color.b = channel(numerator.z);
+
+    // The optimum is the one of L2: under the other metrics (l1, luma), and after rounding,
+    // the color is only changed if the error of the metric over the pixels decreases
+    auto error = [&](Color c) {
+        return visitFitnessMetric(globalCfg.fitnessMetric, [&](auto policy) {
+            using Metric = decltype(policy);
+            Vec3d src = rasterizer::fromColor(c);
+            f64 sum = 0;
+            for (std::size_t i = 0; i < count; ++i) {
+                Vec3d canvas = (alpha * transmittance[i]) * src + rest(i);
+                f64 e = Metric::error(canvas - target[pixels[i]]);
+                sum += Metric::weighted ? e * (1.0 + weights[pixels[i]]) : e;
+            }
+            return sum;
+        });
+    };
+    if (error(color) >= error(triangle.color))
+        return false;
+
+    individual.setColor(index, color);
+    return true;
+}
+
+GA_NAMESPACE_END
@@ -0,0 +1,39 @@
+#ifndef GENALGO_COLORREFIT_HPP
+#define GENALGO_COLORREFIT_HPP
+
+#include "base.hpp"
+#include "Individual.hpp"
+#include "Vec.hpp"
+#include <vector>
+
+GA_NAMESPACE_BEGIN
+
+// Lamarckian refit of the color of a triangle. A pixel it covers ends up, after all the
+// triangles are blended (see Rasterizer.hpp), as
+//   final = alpha * T * color + (1 - alpha) * T * below + above
+// where below is the canvas under the triangle, and T and above the transmittance and the
+// color of the triangles drawn over it. The final canvas is linear in color, so the RGB
+// minimizing the L2 error (weighted by 1 + weight for weighted metrics) has a closed form:
+//   color = sum(w * (target - r)) / sum(w^2), with w = alpha * T and r the rest.
+// It's only the optimum of the L2 metrics, so the refit keeps the old color unless the new
+// one lowers the error of globalCfg.fitnessMetric over the pixels of the triangle.
+// Only the triangles overlapping it are rasterized, and only over its pixels. They are found
+// with the spatial index of the individual if globalCfg.spatialIndex is set.
+class ColorRefit {
+public:
+    // Sets the RGB of the index-th triangle to its optimum, rounded and clamped to [0, 255].
+    // Returns false, leaving it unchanged, if none of its pixels is visible or the error
+    // doesn't decrease.
+    bool refit(Individual& individual, i32 index);
+private:
+    // Scratch space, for the pixels covered by the triangle
+    std::vector<i32> pixels;
+    std::vector<Vec3d> below;
+    std::vector<Vec3d> above;
+    std::vector<f64> transmittance;
+    std::vector<i32> candidates;
+};
+
+GA_NAMESPACE_END
+
+#endif // GENALGO_COLORREFIT_HPP
@@ -7,6 +7,9 @@
 #include "Vec.hpp"
 #include "defer.hpp"
 #include "GlobalConfig.hpp"
+#include "Rasterizer.hpp"
+#include "TargetCache.hpp"
+#include "TileLayout.hpp"
 
 static void cudaCheck(cudaError_t error, const char* message) {
     if (error != cudaSuccess) {
@@ -63,12 +66,14 @@ Vec3f fromColor(Color c) {
     return Vec3f{1.0f * c.r, 1.0f * c.g, 1.0f * c.b};
 }
 
-class CudaFitnessEngine::Engine {
+class CudaEngine {
 public:
-    Engine();
-    ~Engine();
+    CudaEngine();
+    ~CudaEngine();
 
+    template <typename Metric>
     void evaluate(std::vector<Individual>& individuals);
+    void getCanvas(i32 index, Vec3d dst[]);
 private:
     std::vector<VecTriangle> triangles;
     std::vector<f64> fitnesses;
@@ -80,12 +85,16 @@ private:
     Vec3f* deviceImage = nullptr;
     f64* deviceWeights = nullptr;
 
+    // Canvases are stored in tiles of 16x16 pixels: the pixel tileOrder[j] of the image
+    // is the j-th pixel of a canvas
+    std::vector<i32> tileOrder;
+
     i32 imWidth, imHeight, imSize;
     i64 canvasSize;
     i32 populationSize;
 };
 
-CudaFitnessEngine::Engine::Engine() {
+CudaEngine::CudaEngine() {
     populationSize = globalCfg.populationSize;
     imWidth = globalCfg.targetImage.getWidth();
     imHeight = globalCfg.targetImage.getHeight();
@@ -108,35 +117,27 @@ CudaFitnessEngine::Engine::Engine() {
     deviceMalloc(&deviceWeights, imSize);
     deviceMalloc(&deviceIndividualInfo, populationSize);
 
+    tileOrder.resize(imSize);
+
+    // The tiled target is stored in the target cache, if there's one
+    if (TargetCache const* cache = globalCfg.targetImage.getCache()) {
+        std::copy(cache->getTileOrder(), cache->getTileOrder() + imSize, tileOrder.begin());
+        copyHostToDevice(deviceImage, cache->getTiledTarget(), imSize);
+        copyHostToDevice(deviceWeights, cache->getTiledWeights(), imSize);
+        return;
+    }
+
     auto hostImage = std::make_unique<Vec3f[]>(imSize);
     auto hostWeights = std::make_unique<f64[]>(imSize);
 
     Color* target = reinterpret_cast<Color*>(globalCfg.targetImage.getData());
     f64* weights = globalCfg.targetImage.getWeights();
-    i32 j = 0;
-
-    for (i32 tileY = 0; tileY < (imHeight + 15)/16; ++tileY) {
-        for (i32 tileX = 0; tileX < (imWidth + 15)/16; ++tileX) {
-            for (i32 dy = 0; dy < 16; dy++) {
-                for (i32 dx = 0; dx < 16; dx++) {
-                    i32 y = tileY * 16 + dy;
-                    i32 x = tileX * 16 + dx;
-                    if (x >= imWidth || y >= imHeight)
-                        continue;
-
-                    i32 i = y * imWidth + x;
-                    Vec3f rgb = (target[i].a / 255.0f) * fromColor(target[i]);
-
-                    hostImage[j] = rgb;
-                    hostWeights[j] = weights[i];
-                    ++j;
-                }
-            }
-        }
-    }
-    if (j != imSize) {
-        std::fprintf(stderr, "CudaFitnessEngine: j != imSize\n");
-        std::abort();
+    computeTileOrder(imWidth, imHeight, tileOrder.data());
+
+    for (i32 j = 0; j < imSize; ++j) {
+        i32 i = tileOrder[j];
+        hostImage[j] = (target[i].a / 255.0f) * fromColor(target[i]);
+        hostWeights[j] = weights[i];
     }
 
     copyHostToDevice(deviceImage, hostImage.get(), imSize);
@@ -153,7 +154,7 @@ CudaFitnessEngine::Engine::Engine() {
     // }
 }
 
-CudaFitnessEngine::Engine::~Engine() {
+CudaEngine::~CudaEngine() {
     cudaFree(deviceFitnesses);
     cudaFree(deviceCanvas);
     cudaFree(deviceImage);
@@ -425,17 +426,21 @@ void drawTriangles(GPUImageInfo image, GPUDrawData data) {
     // i32 offset = dy * colW + dx;
 
     // i32 xy = pixelsBeforeRows + pixelsBeforeTiles + offset;
-    i32 m = 16;
-    if (tileY == image.height / 16)
-        m = image.height % 16;
+    // Same order as the target: tiles row by row, the last row and column of tiles
+    // may be smaller than 16x16
+    i32 rowH = min(16, height - tileY * 16);
+    i32 colW = min(16, width - tileX * 16);
+    i32 dy = threadIdx.x / 16;
+    i32 dx = threadIdx.x % 16;
 
-    i32 xy = 16 * (tileY * width + m * tileX) + threadIdx.x;
+    i32 xy = tileY * 16 * width + rowH * tileX * 16 + dy * colW + dx;
 
     canvas[xy] = pixel;
 }
 
 // Number of threads per individual in the computeFitnessKernel
 // It's better if it's a multiple of 32
+template <typename Metric>
 static __global__
 void computeFitnessKernel(
         Vec3f* target, f64* weights, Vec3f* canvas_, 
@@ -458,12 +463,16 @@ void computeFitnessKernel(
         Vec3f imgPixel = target[xy];
         Vec3f pixel = canvas[xy];
 
-        double dx = imgPixel.x - pixel.x;
-        double dy = imgPixel.y - pixel.y;
-        double dz = imgPixel.z - pixel.z;
+        Vec3d diff {
+            static_cast<f64>(pixel.x) - imgPixel.x,
+            static_cast<f64>(pixel.y) - imgPixel.y,
+            static_cast<f64>(pixel.z) - imgPixel.z
+        };
 
-        double sum = dx * dx + dy * dy + dz * dz;
-        fitnessSum += sum * (1.0 + weights[xy]);
+        if constexpr (Metric::weighted)
+            fitnessSum += Metric::error(diff) * (1.0 + weights[xy]);
+        else
+            fitnessSum += Metric::error(diff);
     }
 
     extern __shared__ f64 fitnessesSums[];
@@ -479,15 +488,16 @@ void computeFitnessKernel(
     }
 }
 
-void CudaFitnessEngine::Engine::evaluate(std::vector<Individual>& individuals) {
+template <typename Metric>
+void CudaEngine::evaluate(std::vector<Individual>& individuals) {
     if (individuals.size() != populationSize) {
         std::fprintf(stderr, "CudaFitnessEngine::evaluate: individuals.size() != populationSize\n");
         std::abort();
     }
 
-    defer { profiler.stop("cudaFitness:cleanup"); };
+    defer { profiler.stop(ProfilerZone::cudaCleanup); };
 
-    profiler.start("cudaFitness:prepare", "Prepare");
+    profiler.start(ProfilerZone::cudaPrepare);
     i32 maxTriangles = 0;
     triangles.clear();
     for (i32 i = 0; i < populationSize; ++i) {
@@ -518,18 +528,18 @@ void CudaFitnessEngine::Engine::evaluate(std::vector<Individual>& individuals) {
             triangles.push_back(vt);
         }
     }
-    profiler.stop("cudaFitness:prepare");
+    profiler.stop(ProfilerZone::cudaPrepare);
 
-    profiler.start("cudaFitness:copy2device", "Copy");
+    profiler.start(ProfilerZone::cudaCopy2Device);
     auto deviceTriangles = deviceMalloc<VecTriangle>(triangles.size());
     defer { cudaFree(deviceTriangles); };
 
     copyHostToDevice(deviceTriangles, triangles.data(), triangles.size());
     copyHostToDevice(deviceIndividualInfo, hostIndividualInfo.get(), populationSize);
     cudaDeviceSynchronize();
-    profiler.stop("cudaFitness:copy2device");
+    profiler.stop(ProfilerZone::cudaCopy2Device);
 
-    profiler.start("cudaFitness:draw", "Draw");
+    profiler.start(ProfilerZone::cudaDraw);
     {
         // Must be 256 always
         constexpr u32 THREADS = 256;
@@ -559,40 +569,83 @@ void CudaFitnessEngine::Engine::evaluate(std::vector<Individual>& individuals) {
         CUDA_CHECK(cudaPeekAtLastError());
         CUDA_CHECK(cudaDeviceSynchronize());
     }
-    profiler.stop("cudaFitness:draw");
+    profiler.stop(ProfilerZone::cudaDraw);
 
-    profiler.start("cudaFitness:compute", "Compute");
+    profiler.start(ProfilerZone::cudaCompute);
     {
         i32 N = populationSize;
         u32 THREADS = 32;
         u32 BLOCKS = N;
         cudaMemset(deviceFitnesses, 0, populationSize * sizeof(*deviceFitnesses));
-        computeFitnessKernel<<<BLOCKS, THREADS, THREADS * sizeof(f64)>>>(
+        computeFitnessKernel<Metric><<<BLOCKS, THREADS, THREADS * sizeof(f64)>>>(
                 deviceImage, deviceWeights, deviceCanvas, deviceFitnesses, imWidth, imHeight, populationSize);
         CUDA_CHECK(cudaPeekAtLastError());
         copyDeviceToHost(fitnesses.data(), deviceFitnesses, populationSize);
         cudaDeviceSynchronize();
     }
-    profiler.stop("cudaFitness:compute");
+    profiler.stop(ProfilerZone::cudaCompute);
 
-    profiler.start("cudaFitness:copy2individuals", "Copy to individuals");
+    profiler.start(ProfilerZone::cudaCopy2Individuals);
     for (i32 i = 0; i < populationSize; ++i) {
-        individuals[i].setFitness(std::pow(fitnesses[i], 0.7));
+        individuals[i].setFitness(Metric::finish(fitnesses[i]));
     }
-    profiler.stop("cudaFitness:copy2individuals");
+    profiler.stop(ProfilerZone::cudaCopy2Individuals);
 
-    profiler.start("cudaFitness:cleanup", "Cleanup");
+    profiler.start(ProfilerZone::cudaCleanup);
+}
+
+void CudaEngine::getCanvas(i32 index, Vec3d dst[]) {
+    if (index < 0 || index >= populationSize) {
+        std::fprintf(stderr, "CudaFitnessEngine::getCanvas: index out of range: %d\n", index);
+        std::abort();
+    }
+
+    auto canvas = std::make_unique<Vec3f[]>(imSize);
+    copyDeviceToHost(canvas.get(), deviceCanvas + static_cast<i64>(index) * imSize, imSize);
+    for (i32 j = 0; j < imSize; ++j) {
+        Vec3f pixel = canvas[j];
+        dst[tileOrder[j]] = Vec3d{pixel.x, pixel.y, pixel.z};
+    }
 }
 
 // Wrapper for the actual implementation of the engine
 
-CudaFitnessEngine::CudaFitnessEngine() :
-    impl(std::make_unique<Engine>()) {}
+template <typename Metric>
+CudaFitnessEngine<Metric>::CudaFitnessEngine() :
+    impl(std::make_unique<CudaEngine>()) {}
+
+template <typename Metric>
+CudaFitnessEngine<Metric>::~CudaFitnessEngine() = default;
 
-CudaFitnessEngine::~CudaFitnessEngine() = default;
+template <typename Metric>
+bool CudaFitnessEngine<Metric>::isAvailable() noexcept {
+    int count = 0;
+    return cudaGetDeviceCount(&count) == cudaSuccess && count > 0;
+}
+
+template <typename Metric>
+void CudaFitnessEngine<Metric>::evaluate_impl(std::vector<Individual>& individuals) {
+    impl->evaluate<Metric>(individuals);
+}
 
-void CudaFitnessEngine::evaluate_impl(std::vector<Individual>& individuals) {
-    impl->evaluate(individuals);
+template <typename Metric>
+bool CudaFitnessEngine<Metric>::getCanvas(i32 index, Vec3d dst[]) {
+    impl->getCanvas(index, dst);
+    return true;
 }
 
+template <typename Metric>
+bool CudaFitnessEngine<Metric>::getResidual(i32 index, f64 dst[]) {
+    i32 size = globalCfg.targetImage.getWidth() * globalCfg.targetImage.getHeight();
+    auto canvas = std::make_unique<Vec3d[]>(size);
+    impl->getCanvas(index, canvas.get());
+    rasterizer::residual<Metric>(dst, canvas.get(), globalCfg.targetImage.getPremultiplied(),
+            globalCfg.targetImage.getWeights(), size);
+    return true;
+}
+
+#define GA_CUDA_INSTANTIATE(M) template class CudaFitnessEngine<metric::M>;
+GA_FITNESS_METRICS(GA_CUDA_INSTANTIATE)
+#undef GA_CUDA_INSTANTIATE
+
 GA_NAMESPACE_END
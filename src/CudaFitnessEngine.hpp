@@ -2,11 +2,16 @@
 #define GENALGO_CUDAFITNESSENGINE_HPP
 
 #include "FitnessEngine.hpp"
+#include "FitnessMetric.hpp"
 #include "Population.hpp"
 #include <memory>
 
 GA_NAMESPACE_BEGIN
 
+// Device buffers and kernels, only the fitness kernel depends on the metric
+class CudaEngine;
+
+template <typename Metric = metric::L2>
 class CudaFitnessEngine final : public FitnessEngine {
 public:
     CudaFitnessEngine();
@@ -16,12 +21,25 @@ public:
         return "CudaFitnessEngine";
     }
 
+    virtual const char* getMetricName() const noexcept override {
+        return Metric::name;
+    }
+
     void evaluate_impl(std::vector<Individual>& individuals) override;
+    bool getCanvas(i32 index, Vec3d dst[]) override;
+    bool getResidual(i32 index, f64 dst[]) override;
+
+    // Whether there is a CUDA device, the constructor aborts otherwise
+    static bool isAvailable() noexcept;
 private:
-    class Engine;
-    std::unique_ptr<Engine> impl;
+    std::unique_ptr<CudaEngine> impl;
 };
 
+// Instantiated in CudaFitnessEngine.cu
+#define GA_CUDA_EXTERN(M) extern template class CudaFitnessEngine<metric::M>;
+GA_FITNESS_METRICS(GA_CUDA_EXTERN)
+#undef GA_CUDA_EXTERN
+
 GA_NAMESPACE_END
 
 #endif // GENALGO_CUDAFITNESSENGINE_HPP
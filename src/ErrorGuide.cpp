@@ -0,0 +1,54 @@
+#include "ErrorGuide.hpp"
+
+#include "FitnessEngine.hpp"
+#include "GlobalConfig.hpp"
+#include "Rasterizer.hpp"
+#include "TileLayout.hpp"
+#include "globalRNG.hpp"
+#include <algorithm>
+
+GA_NAMESPACE_BEGIN
+
+ErrorGuide errorGuide;
+
+void ErrorGuide::update(FitnessEngine& engine, Individual const& individual, i32 index) {
+    width = globalCfg.targetImage.getWidth();
+    height = globalCfg.targetImage.getHeight();
+    const i32 size = width * height;
+
+    residual.resize(size);
+    if (!engine.getResidual(index, residual.data())) {
+        canvas.resize(size);
+        Vec3d const* target = globalCfg.targetImage.getPremultiplied();
+        f64 const* weights = globalCfg.targetImage.getWeights();
+        visitFitnessMetric(globalCfg.fitnessMetric, [&](auto policy) {
+            rasterizer::clear(canvas.data(), size);
+            rasterizer::rasterize(canvas.data(), individual, width, height);
+            rasterizer::residual<decltype(policy)>(residual.data(), canvas.data(), target, weights, size);
+        });
+    }
+
+    tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+    const i32 tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+    tileErrors.assign(static_cast<std::size_t>(tilesX) * tilesY, 0.0);
+    for (i32 y = 0; y < height; ++y) {
+        f64* row = &tileErrors[(y / TILE_SIZE) * tilesX];
+        for (i32 x = 0; x < width; ++x)
+            row[x / TILE_SIZE] += residual[y * width + x];
+    }
+    tiles.build(tileErrors.data(), tilesX * tilesY);
+}
+
+bool ErrorGuide::sample(Point<i32>* point) const {
+    if (tiles.empty())
+        return false;
+
+    i32 tile = tiles.sample(randomF64(0, 1));
+    i32 x0 = (tile % tilesX) * TILE_SIZE;
+    i32 y0 = (tile / tilesX) * TILE_SIZE;
+    point->x = randomI32(x0, std::min(x0 + TILE_SIZE, width) - 1);
+    point->y = randomI32(y0, std::min(y0 + TILE_SIZE, height) - 1);
+    return true;
+}
+
+GA_NAMESPACE_END
@@ -0,0 +1,46 @@
+#ifndef GENALGO_ERRORGUIDE_HPP
+#define GENALGO_ERRORGUIDE_HPP
+
+#include "base.hpp"
+#include "AliasTable.hpp"
+#include "Individual.hpp"
+#include "Point.hpp"
+#include "Vec.hpp"
+#include <vector>
+
+GA_NAMESPACE_BEGIN
+
+class FitnessEngine;
+
+// Where the best individual is far from the target. The residual error of its pixels is
+// summed over tiles of TILE_SIZE x TILE_SIZE pixels, and points are sampled with a
+// probability proportional to the error of their tile, so new triangles are centered
+// where they are most likely to improve the fitness.
+class ErrorGuide {
+public:
+    // Recomputes the error map from the index-th individual of the last evaluation of
+    // the engine. If the engine doesn't keep its canvases, the individual is rasterized.
+    void update(FitnessEngine& engine, Individual const& individual, i32 index);
+
+    // Samples a pixel, uniformly within a tile chosen by its error. Returns false if
+    // there is no error map yet (or the individual is perfect).
+    bool sample(Point<i32>* point) const;
+
+    bool isReady() const noexcept { return !tiles.empty(); }
+
+    // Error of each pixel of the last update, row-major
+    std::vector<f64> const& getResidual() const noexcept { return residual; }
+private:
+    std::vector<f64> residual;
+    std::vector<Vec3d> canvas;
+    std::vector<f64> tileErrors;
+    AliasTable tiles;
+    i32 width = 0, height = 0;
+    i32 tilesX = 0;
+};
+
+extern ErrorGuide errorGuide;
+
+GA_NAMESPACE_END
+
+#endif // GENALGO_ERRORGUIDE_HPP
@@ -0,0 +1,104 @@
+#ifndef GENALGO_FENWICKTREE_HPP
+#define GENALGO_FENWICKTREE_HPP
+
+#include "base.hpp"
+#include <vector>
+
+GA_NAMESPACE_BEGIN
+
+// Binary indexed tree of non-negative weights: O(log n) updates and weighted sampling,
+// O(n) build. Inserting or erasing a weight shifts the ones after it, and the tree is
+// rebuilt from the weights by the next refresh, in O(n) but without calling weight again.
+// The buffers are reused, so rebuilding doesn't allocate once they are large enough.
+class FenwickTree {
+public:
+    // Builds the tree of weight(0), ..., weight(n - 1)
+    template <typename F>
+    void build(i32 n, F&& weight) {
+        values.resize(n);
+        for (i32 i = 0; i < n; ++i)
+            values[i] = weight(i);
+        stale = true;
+        refresh();
+    }
+
+    void set(i32 index, f64 weight) noexcept {
+        f64 delta = weight - values[index];
+        values[index] = weight;
+        if (stale)
+            return;
+        for (i32 i = index + 1; i < static_cast<i32>(tree.size()); i += i & -i)
+            tree[i] += delta;
+    }
+
+    void insert(i32 index, f64 weight) {
+        values.insert(values.begin() + index, weight);
+        stale = true;
+    }
+
+    void erase(i32 index) {
+        values.erase(values.begin() + index);
+        stale = true;
+    }
+
+    // Keeps the first size weights
+    void truncate(i32 size) {
+        if (size < this->size()) {
+            values.resize(size);
+            stale = true;
+        }
+    }
+
+    f64 weight(i32 index) const noexcept { return values[index]; }
+
+    // Rebuilds the tree after insertions and erasures, must be called before total and sample
+    void refresh() {
+        if (!stale)
+            return;
+        const i32 n = size();
+        tree.resize(n + 1);
+        tree[0] = 0;
+        for (i32 i = 0; i < n; ++i)
+            tree[i + 1] = values[i];
+        for (i32 i = 1; i <= n; ++i) {
+            i32 parent = i + (i & -i);
+            if (parent <= n)
+                tree[parent] += tree[i];
+        }
+        stale = false;
+    }
+
+    f64 total() const noexcept {
+        f64 sum = 0;
+        for (i32 i = size(); i > 0; i -= i & -i)
+            sum += tree[i];
+        return sum;
+    }
+
+    // Smallest index whose prefix sum (inclusive) is greater than u, for u in [0, total())
+    i32 sample(f64 u) const noexcept {
+        const i32 n = size();
+        i32 step = 1;
+        while (step * 2 <= n)
+            step *= 2;
+
+        i32 position = 0;
+        for (; step > 0; step /= 2) {
+            if (position + step <= n && tree[position + step] <= u) {
+                position += step;
+                u -= tree[position];
+            }
+        }
+        return position < n ? position : n - 1;
+    }
+
+    i32 size() const noexcept { return static_cast<i32>(values.size()); }
+private:
+    std::vector<f64> tree;      // 1-based, tree[i] is the sum of the (i & -i) weights up to i
+    std::vector<f64> values;
+    bool stale = false;
+};
+
+GA_NAMESPACE_END
+
+#endif // GENALGO_FENWICKTREE_HPP
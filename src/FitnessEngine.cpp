@@ -1,5 +1,13 @@
 #include "FitnessEngine.hpp"
+#include "CudaFitnessEngine.hpp"
 #include "GlobalConfig.hpp"
+#include "MTFitnessEngine.hpp"
+#include "PoorProfiler.hpp"
+#include "Rasterizer.hpp"
+#include "STFitnessEngine.hpp"
+#include <algorithm>
+#include <cctype>
+#include <string>
 
 GA_NAMESPACE_BEGIN
 
@@ -18,9 +26,115 @@ void FitnessEngine::computeWeightedFitness(std::vector<Individual>& individuals,
     }
 }
 
+// Number of the last opaque triangles an occlusion is searched in, bounds the cost of cull
+constexpr std::size_t MAX_OCCLUDERS = 32;
+
+// Whether the pixels covered by t are all covered by the opaque triangle occluder. The
+// pixels covered by a triangle are those of its bounding box in a convex set (see
+// rasterizer::pointInTriangle), so the ones of t are covered if its vertices are.
+static bool isOccluded(Triangle const& t, Triangle const& occluder) {
+    i32 minX = std::min({occluder.a.x, occluder.b.x, occluder.c.x});
+    i32 minY = std::min({occluder.a.y, occluder.b.y, occluder.c.y});
+    i32 maxX = std::max({occluder.a.x, occluder.b.x, occluder.c.x});
+    i32 maxY = std::max({occluder.a.y, occluder.b.y, occluder.c.y});
+    for (Point<i32> const& p : {t.a, t.b, t.c}) {
+        if (p.x < minX || p.x > maxX || p.y < minY || p.y > maxY)
+            return false;
+        if (!rasterizer::pointInTriangle(p, occluder.a, occluder.b, occluder.c))
+            return false;
+    }
+    return true;
+}
+
+void FitnessEngine::cull(Individual const& src, Individual& dst) {
+    const i32 width = globalCfg.targetImage.getWidth();
+    const i32 height = globalCfg.targetImage.getHeight();
+
+    // Back to front, so the opaque triangles drawn after one are known
+    dst.clear();
+    occluders.clear();
+    for (i32 i = src.size() - 1; i >= 0; --i) {
+        Triangle const& t = src[i];
+        ++cullStats.total;
+
+        // Blending with alpha 0 leaves the canvas unchanged, and blending with alpha 255
+        // replaces it: both exactly
+        if (t.color.a == 0) {
+            ++cullStats.transparent;
+            continue;
+        }
+        if (std::max({t.a.x, t.b.x, t.c.x}) < 0 || std::min({t.a.x, t.b.x, t.c.x}) >= width ||
+            std::max({t.a.y, t.b.y, t.c.y}) < 0 || std::min({t.a.y, t.b.y, t.c.y}) >= height) {
+            ++cullStats.outside;
+            continue;
+        }
+        if (std::any_of(occluders.begin(), occluders.end(), [&](Triangle const* o) { return isOccluded(t, *o); })) {
+            ++cullStats.occluded;
+            continue;
+        }
+
+        dst.push_back(t);
+        if (t.color.a == 255 && occluders.size() < MAX_OCCLUDERS)
+            occluders.push_back(&t);
+    }
+    std::reverse(dst.begin(), dst.end());
+}
+
 void FitnessEngine::evaluate(std::vector<Individual>& individuals) {
-    evaluate_impl(individuals);
+    if (globalCfg.cullDisabled) {
+        evaluate_impl(individuals);
+    } else {
+        // The copies keep their buffers between generations
+        profiler.start(ProfilerZone::cull);
+        culled.resize(individuals.size());
+        for (std::size_t i = 0; i < individuals.size(); ++i)
+            cull(individuals[i], culled[i]);
+        profiler.stop(ProfilerZone::cull);
+
+        evaluate_impl(culled);
+        for (std::size_t i = 0; i < individuals.size(); ++i)
+            individuals[i].setFitness(culled[i].getFitness());
+    }
+    computeWeightedFitness(individuals, penalty_tag::linear);
+}
+
+void FitnessEngine::evaluateReference(std::vector<Individual>& individuals) {
+    const i32 width = globalCfg.targetImage.getWidth();
+    const i32 height = globalCfg.targetImage.getHeight();
+    Vec3d const* target = globalCfg.targetImage.getPremultiplied();
+    f64 const* weights = globalCfg.targetImage.getWeights();
+
+    std::vector<Vec3d> canvas(static_cast<std::size_t>(width) * height);
+    visitFitnessMetric(globalCfg.fitnessMetric, [&](auto policy) {
+        using Metric = decltype(policy);
+        for (Individual& i : individuals)
+            i.setFitness(rasterizer::fitness<Metric>(canvas.data(), target, weights, i, width, height));
+    });
     computeWeightedFitness(individuals, penalty_tag::linear);
 }
 
+CullStats FitnessEngine::collectCullStats() noexcept {
+    CullStats stats = cullStats;
+    cullStats = {};
+    return stats;
+}
+
+std::unique_ptr<FitnessEngine> createFitnessEngine(std::string_view name, FitnessMetric metric) {
+    std::string fitnessEngine(name);
+    for (char& c : fitnessEngine)
+        c = std::toupper(c);
+
+    return visitFitnessMetric(metric, [&](auto policy) -> std::unique_ptr<FitnessEngine> {
+        using Metric = decltype(policy);
+        if (fitnessEngine == "CUDA") {
+            return std::make_unique<CudaFitnessEngine<Metric>>();
+        } else if (fitnessEngine == "MT") {
+            return std::make_unique<MTFitnessEngine<Metric>>();
+        } else if (fitnessEngine == "ST") {
+            return std::make_unique<STFitnessEngine<Metric>>();
+        }
+        return nullptr;
+    });
+}
+
 GA_NAMESPACE_END
@@ -2,19 +2,54 @@
 #define GENALGO_FITNESSENGINE_HPP
 
 #include "base.hpp"
+#include "FitnessMetric.hpp"
 #include "Individual.hpp"
+#include "Vec.hpp"
+#include <memory>
+#include <string_view>
 #include <vector>
 
 GA_NAMESPACE_BEGIN
 
+// Triangles dropped by the culling pre-pass of FitnessEngine::evaluate
+struct CullStats {
+    i64 transparent = 0;    // Alpha 0
+    i64 outside = 0;        // Bounding box outside of the image
+    i64 occluded = 0;       // Inside a later opaque triangle
+    i64 total = 0;          // Triangles evaluated, culled or not
+
+    i64 culled() const noexcept { return transparent + outside + occluded; }
+};
+
 class FitnessEngine {
 public:
     FitnessEngine() noexcept = default;
     virtual ~FitnessEngine() = default;
 
     virtual const char* getEngineName() const noexcept = 0;
+    virtual const char* getMetricName() const noexcept = 0;
 
+    // Unless globalCfg.cullDisabled is set, the engine evaluates copies of the individuals
+    // without the triangles that can't change their canvas (see cull)
     void evaluate(std::vector<Individual>& individuals);
+
+    // Statistics since the last call
+    CullStats collectCullStats() noexcept;
+
+    // Scores a few individuals with the reference rasterizer on the CPU, in the metric of
+    // globalCfg, outside of the evaluation of a population: the engines only evaluate whole
+    // populations. Sets their fitness and weighted fitness.
+    static void evaluateReference(std::vector<Individual>& individuals);
+
+    // Copies the canvas of the index-th individual of the last evaluation into dst
+    // (width * height premultiplied RGB pixels, row-major). Returns false if the
+    // engine doesn't keep its canvases.
+    virtual bool getCanvas([[maybe_unused]] i32 index, [[maybe_unused]] Vec3d dst[]) { return false; }
+
+    // Copies the error of each pixel of the canvas of the index-th individual into dst
+    // (width * height, row-major), the terms of the sum of the metric before finish().
+    // Returns false if the engine doesn't keep its canvases.
+    virtual bool getResidual([[maybe_unused]] i32 index, [[maybe_unused]] f64 dst[]) { return false; }
 protected:
     struct penalty_tag {
         static constexpr struct none_t {} none {};
@@ -27,8 +62,19 @@ protected:
     // some helper functions to avoid code duplication.
     static void computeWeightedFitness(std::vector<Individual>& individuals, penalty_tag::none_t) noexcept;
     static void computeWeightedFitness(std::vector<Individual>& individuals, penalty_tag::linear_t) noexcept;
+private:
+    // Copies into dst the triangles of src that can change the canvas
+    void cull(Individual const& src, Individual& dst);
+
+    std::vector<Individual> culled;
+    std::vector<Triangle const*> occluders;
+    CullStats cullStats;
 };
 
+// Creates an engine by name (CUDA, MT or ST, case insensitive), specialized for the metric.
+// Returns nullptr if the name is unknown.
+std::unique_ptr<FitnessEngine> createFitnessEngine(std::string_view name, FitnessMetric metric = FitnessMetric::l2);
+
 GA_NAMESPACE_END
 
 #endif // GENALGO_FITNESSENGINE_HPP
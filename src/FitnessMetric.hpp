@@ -0,0 +1,130 @@
+#ifndef GENALGO_FITNESSMETRIC_HPP
+#define GENALGO_FITNESSMETRIC_HPP
+
+#include "base.hpp"
+#include "Vec.hpp"
+#include <cmath>
+#include <string_view>
+#include <utility>
+
+GA_NAMESPACE_BEGIN
+
+// Error metrics of the fitness, as policies of the engines. The fitness of an individual is
+//   finish(sum over all pixels of error(canvas - target) * (1 + weight if weighted))
+// The branch on weighted is resolved at compile time, so each metric gets its own kernel.
+// error() is also compiled for the device, finish() only runs on the host.
+namespace metric {
+
+// Sum of the squared RGB differences, the reference fitness
+struct L2 {
+    static constexpr const char* name = "l2";
+    static constexpr bool weighted = false;
+
+    GA_CUDA static f64 error(Vec3d const& diff) { return norm(diff); }
+    static f64 finish(f64 sum) { return sum; }
+};
+
+// L2, with the error of each pixel scaled by 1 + its weight in the weight map of the target
+struct WeightedL2 {
+    static constexpr const char* name = "weighted-l2";
+    static constexpr bool weighted = true;
+
+    GA_CUDA static f64 error(Vec3d const& diff) { return norm(diff); }
+    static f64 finish(f64 sum) { return sum; }
+};
+
+// Sum of the absolute RGB differences, less sensitive to a few very wrong pixels
+struct L1 {
+    static constexpr const char* name = "l1";
+    static constexpr bool weighted = false;
+
+    GA_CUDA static f64 error(Vec3d const& diff) { return fabs(diff.x) + fabs(diff.y) + fabs(diff.z); }
+    static f64 finish(f64 sum) { return sum; }
+};
+
+// Squared difference in BT.601 YCbCr, with luma weighted 6:1:1 against the chroma channels
+// like the PSNR of video codecs. The transform is linear, so it's applied to the difference.
+struct Luma {
+    static constexpr const char* name = "luma";
+    static constexpr bool weighted = false;
+
+    GA_CUDA static f64 error(Vec3d const& diff) {
+        f64 y  =  0.299    * diff.x + 0.587    * diff.y + 0.114    * diff.z;
+        f64 cb = -0.168736 * diff.x - 0.331264 * diff.y + 0.5      * diff.z;
+        f64 cr =  0.5      * diff.x - 0.418688 * diff.y - 0.081312 * diff.z;
+        return 0.75 * y * y + 0.125 * (cb * cb + cr * cr);
+    }
+    static f64 finish(f64 sum) { return sum; }
+};
+
+// Weighted L2 raised to the power 0.7, the fitness the CUDA engine used to compute.
+// It compresses the differences between bad individuals, so the penalty of the
+// triangles weighs more.
+struct PowL2 {
+    static constexpr const char* name = "pow-l2";
+    static constexpr bool weighted = true;
+
+    GA_CUDA static f64 error(Vec3d const& diff) { return norm(diff); }
+    static f64 finish(f64 sum) { return std::pow(sum, 0.7); }
+};
+
+}
+
+// X-macro of the policies, to instantiate the engines with every metric
+#define GA_FITNESS_METRICS(X) \
+    X(L2) \
+    X(WeightedL2) \
+    X(L1) \
+    X(Luma) \
+    X(PowL2)
+
+// Runtime selection of the metric
+enum class FitnessMetric {
+    l2,
+    weightedL2,
+    l1,
+    luma,
+    powL2
+};
+
+// Parses the name of a metric (l2, weighted-l2, l1, luma or pow-l2). Returns false if it's unknown.
+inline bool parseFitnessMetric(std::string_view name, FitnessMetric* out) {
+    constexpr std::pair<std::string_view, FitnessMetric> metrics[] = {
+        {metric::L2::name, FitnessMetric::l2},
+        {metric::WeightedL2::name, FitnessMetric::weightedL2},
+        {metric::L1::name, FitnessMetric::l1},
+        {metric::Luma::name, FitnessMetric::luma},
+        {metric::PowL2::name, FitnessMetric::powL2},
+    };
+    for (auto const& [metricName, value] : metrics) {
+        if (name == metricName) {
+            *out = value;
+            return true;
+        }
+    }
+    return false;
+}
+
+inline const char* fitnessMetricName(FitnessMetric value);
+
+// Calls f with the policy of the metric, e.g. f(metric::L2{}), and returns its result.
+// This is where a runtime metric becomes a compile-time one.
+template <typename F>
+decltype(auto) visitFitnessMetric(FitnessMetric value, F&& f) {
+    switch (value) {
+    case FitnessMetric::weightedL2: return f(metric::WeightedL2{});
+    case FitnessMetric::l1: return f(metric::L1{});
+    case FitnessMetric::luma: return f(metric::Luma{});
+    case FitnessMetric::powL2: return f(metric::PowL2{});
+    case FitnessMetric::l2: break;
+    }
+    return f(metric::L2{});
+}
+
+inline const char* fitnessMetricName(FitnessMetric value) {
+    return visitFitnessMetric(value, [](auto policy) { return decltype(policy)::name; });
+}
+
+GA_NAMESPACE_END
+
+#endif // GENALGO_FITNESSMETRIC_HPP
@@ -0,0 +1,133 @@
+#ifndef GENALGO_FIXEDPOINT_HPP
+#define GENALGO_FIXEDPOINT_HPP
+
+#include "base.hpp"
+#include "FitnessMetric.hpp"
+#include "Individual.hpp"
+#include "Rasterizer.hpp"
+#include "Triangle.hpp"
+#include "Vec.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <type_traits>
+
+GA_NAMESPACE_BEGIN
+
+// Integer pipeline of the CPU engines (see GlobalConfig::fixedPoint). Canvases and the
+// target have u16 channels in 8.8 fixed point, so each blend rounds to 1/256 instead of
+// f64, and is an integer multiply and shift. The sums of L2 and L1 are exact in u64, the
+// other metrics sum the exact differences in f64. The coverage is the one of
+// rasterizer::pointInTriangle, and the fitness matches the reference within the tolerance
+// of genalgo_bench diff.
+namespace fixedpoint {
+
+constexpr i32 FRACTION_BITS = 8;
+constexpr f64 ONE = 1 << FRACTION_BITS;
+
+struct Pixel {
+    u16 r, g, b;
+};
+
+inline u16 toFixed(f64 channel) {
+    return static_cast<u16>(std::lround(channel * ONE));
+}
+
+inline Pixel toFixed(Vec3d const& c) {
+    return Pixel{toFixed(c.x), toFixed(c.y), toFixed(c.z)};
+}
+
+inline void toFixed(Pixel dst[], Vec3d const src[], i32 size) {
+    for (i32 i = 0; i < size; ++i)
+        dst[i] = toFixed(src[i]);
+}
+
+inline Vec3d fromFixed(Pixel p) {
+    return Vec3d{p.r / ONE, p.g / ONE, p.b / ONE};
+}
+
+inline void fromFixed(Vec3d dst[], Pixel const src[], i32 size) {
+    for (i32 i = 0; i < size; ++i)
+        dst[i] = fromFixed(src[i]);
+}
+
+// round(x / 255), exact for x <= 255 * 255 * ONE: the blends of 8.8 channels
+inline u32 divide255(u32 x) {
+    return static_cast<u32>((static_cast<u64>(x + 127) * 0x808081) >> 31);
+}
+
+// Same as rasterizer::blend, rounded to 8.8
+inline u16 blend(u16 dst, u16 src, u32 alpha) {
+    return static_cast<u16>(divide255(src * alpha + dst * (255 - alpha)));
+}
+
+inline void clear(Pixel dst[], i32 size) {
+    for (i32 i = 0; i < size; ++i)
+        dst[i] = Pixel{0, 0, 0};
+}
+
+inline void rasterize(Pixel dst[], Triangle const& t, i32 width, i32 height) {
+    u32 r = static_cast<u32>(t.color.r) << FRACTION_BITS;
+    u32 g = static_cast<u32>(t.color.g) << FRACTION_BITS;
+    u32 b = static_cast<u32>(t.color.b) << FRACTION_BITS;
+    u32 alpha = t.color.a;
+
+    i32 minX = std::max(0, std::min({t.a.x, t.b.x, t.c.x}));
+    i32 minY = std::max(0, std::min({t.a.y, t.b.y, t.c.y}));
+    i32 maxX = std::min(width - 1, std::max({t.a.x, t.b.x, t.c.x}));
+    i32 maxY = std::min(height - 1, std::max({t.a.y, t.b.y, t.c.y}));
+
+    for (i32 y = minY; y <= maxY; ++y) {
+        for (i32 x = minX; x <= maxX; ++x) {
+            if (rasterizer::pointInTriangle({x, y}, t.a, t.b, t.c)) {
+                Pixel& p = dst[y * width + x];
+                p.r = blend(p.r, r, alpha);
+                p.g = blend(p.g, g, alpha);
+                p.b = blend(p.b, b, alpha);
+            }
+        }
+    }
+}
+
+inline void rasterize(Pixel dst[], Individual const& individual, i32 width, i32 height) {
+    for (const Triangle& t : individual)
+        rasterize(dst, t, width, height);
+}
+
+// Same as rasterizer::score, in the units of the reference
+template <typename Metric>
+inline f64 score(Pixel const dst[], Pixel const src[], f64 const weights[], i32 size) {
+    if constexpr (std::is_same_v<Metric, metric::L2>) {
+        u64 sum = 0;
+        for (i32 i = 0; i < size; ++i) {
+            i64 r = dst[i].r - src[i].r;
+            i64 g = dst[i].g - src[i].g;
+            i64 b = dst[i].b - src[i].b;
+            sum += static_cast<u64>(r * r + g * g + b * b);
+        }
+        return Metric::finish(sum / (ONE * ONE));
+    } else if constexpr (std::is_same_v<Metric, metric::L1>) {
+        u64 sum = 0;
+        for (i32 i = 0; i < size; ++i) {
+            sum += static_cast<u64>(std::abs(dst[i].r - src[i].r) + std::abs(dst[i].g - src[i].g)
+                    + std::abs(dst[i].b - src[i].b));
+        }
+        return Metric::finish(sum / ONE);
+    } else {
+        f64 fitness = 0.0;
+        for (i32 i = 0; i < size; ++i) {
+            Vec3d diff = fromFixed(dst[i]) - fromFixed(src[i]);
+            if constexpr (Metric::weighted)
+                fitness += Metric::error(diff) * (1.0 + weights[i]);
+            else
+                fitness += Metric::error(diff);
+        }
+        return Metric::finish(fitness);
+    }
+}
+
+}
+
+GA_NAMESPACE_END
+
+#endif // GENALGO_FIXEDPOINT_HPP
@@ -1,6 +1,8 @@
 #include "GlobalConfig.hpp"
+#include <algorithm>
 #include <cstdio>
 #include <cstring>
+#include <iterator>
 #include <limits>
 #include <random>
 
@@ -13,13 +15,50 @@ static bool print_usage(bool in_help = false) {
     std::fprintf(out, "Options:\n");
     std::fprintf(out, "  -i, --input <image>      Input image file\n");
     std::fprintf(out, "  -o, --output <svg>       Output SVG file\n");
+    std::fprintf(out, "  --image <file>           Output PNG/PPM file of the best individual\n");
+    std::fprintf(out, "  --scale <n>              Scale of the SVG/PNG/PPM output (default = 16)\n");
+    std::fprintf(out, "  --supersample <n>        Samples per axis for each output pixel (default = 1)\n");
+    std::fprintf(out, "  --timelapse <y4m>        Output Y4M video with the best individual over time\n");
+    std::fprintf(out, "  --timelapse-period <n>   Number of generations between timelapse frames (default = period)\n");
+    std::fprintf(out, "  --timelapse-scale <n>    Scale of the timelapse frames (default = 1)\n");
     std::fprintf(out, "  -gi, --gen-input <file>  Input file to continue from\n");
     std::fprintf(out, "  -go, --gen-output <file> Output file to save the generation\n");
     std::fprintf(out, "  -s, --seed <seed>        Seed for the random number generator (default = <platform-specific-random>)\n");
     std::fprintf(out, "  -e, --engine <engine>    Fitness engine to use (default = CUDA)\n");
+    std::fprintf(out, "  -m, --metric <metric>    Error metric of the fitness: l2, weighted-l2, l1, luma or pow-l2\n");
+    std::fprintf(out, "                           (default = l2)\n");
+    std::fprintf(out, "  --weight-map <map>       Weights of the pixels for the weighted metrics: detail, sobel,\n");
+    std::fprintf(out, "                           variance or none (default = detail)\n");
+    std::fprintf(out, "  --target-cache <dir>     Cache the preprocessed target in dir, memory-mapped by later runs\n");
+    std::fprintf(out, "  --error-guided <p>       Probability that new triangles are centered on the error of the\n");
+    std::fprintf(out, "                           best individual (default = 0)\n");
+    std::fprintf(out, "  --color-jitter <n>       Random change of the colors of new triangles, from the mean of\n");
+    std::fprintf(out, "                           the target under them (0-255, default = 16)\n");
+    std::fprintf(out, "  --refit <n>              Number of triangles of each child whose color is set to the one\n");
+    std::fprintf(out, "                           minimizing the L2 error, before scoring, if it lowers the error\n");
+    std::fprintf(out, "                           of the metric (default = 0)\n");
+    std::fprintf(out, "  --spatial-index          Index the triangles of the individuals, for the merges and refits\n");
+    std::fprintf(out, "  --adaptive-mutation      Adapt the probabilities of the mutation operators to the fraction\n");
+    std::fprintf(out, "                           of their children that enter the breeding pool\n");
     std::fprintf(out, "  --period <n>             Number of generations between renders/logging (default = 50)\n");
+    std::fprintf(out, "  --trace <file>           Output Chrome trace (JSON) of the profiler zones\n");
+    std::fprintf(out, "  --metrics <file>         Output metrics every log period (JSON Lines, or CSV with .csv extension)\n");
+    std::fprintf(out, "  --prometheus <file>      Output the latest metrics for the Prometheus textfile collector\n");
+    std::fprintf(out, "  --prune <threshold>      Remove the triangles of the best individual whose removal\n");
+    std::fprintf(out, "                           increases the error by at most threshold, every log period\n");
+    std::fprintf(out, "  --prune-elites           Also prune the elites\n");
+    std::fprintf(out, "  --lineage                Log the success and cost of each mutation operator\n");
+    std::fprintf(out, "  --genealogy <file>       Output the parents, operators and fitness of every child (CSV),\n");
+    std::fprintf(out, "                           implies --lineage\n");
+    std::fprintf(out, "  --front-to-back <t>      Composite the triangles front to back in the CPU engines, stopping\n");
+    std::fprintf(out, "                           at the pixels whose transmittance is at most t (0-1, 0 = exact)\n");
+    std::fprintf(out, "  --fixed-point            Blend in 8.8 fixed point and sum the error in integers in the\n");
+    std::fprintf(out, "                           CPU engines\n");
+    std::fprintf(out, "  --perf-counters          Log IPC, cache and branch misses of the profiler zones (Linux)\n");
     std::fprintf(out, "  --no-render              Disable rendering\n");
     std::fprintf(out, "  --no-breed               Disable breeding\n");
+    std::fprintf(out, "  --no-cull                Evaluate the triangles that can't change the canvas\n");
+    std::fprintf(out, "  --no-batch               Evaluate small targets one individual at a time in the MT engine\n");
     if (!in_help) return false;
     std::fprintf(out, "Renderer keybindings:\n");
     std::fprintf(out, "  S                        Toggle showing the original image\n");
@@ -58,17 +97,54 @@ static bool to_u32(const char* str, u32* out) {
     return true;
 }
 
+static bool to_f64(const char* str, f64* out) {
+    char* end;
+    f64 val = std::strtod(str, &end);
+    if (end == str || *end != '\0')
+        return false;
+    *out = val;
+    return true;
+}
+
 bool GlobalConfig::setup(int argc, char* argv[]) {
     inputFilename = nullptr;
     outputFilename = nullptr;
     outputSVG = nullptr;
+    outputImage = nullptr;
+    timelapseFilename = nullptr;
+    traceFilename = nullptr;
+    metricsFilename = nullptr;
+    prometheusFilename = nullptr;
+    perfCounters = false;
     fitnessEngine = "CUDA";
+    fitnessMetric = FitnessMetric::l2;
+    weightMap = WeightMap::detail;
+    targetCacheDir = nullptr;
+    errorGuidedChance = 0;
+    colorJitter = 16;
+    refitTriangles = 0;
+    spatialIndex = false;
+    adaptiveMutation = false;
+    lineage = false;
+    prune = false;
+    pruneThreshold = 0;
+    pruneElites = false;
+    genealogyFilename = nullptr;
     breedDisabled = false;
+    cullDisabled = false;
+    batchDisabled = false;
+    frontToBack = false;
+    minTransmittance = 0;
+    fixedPoint = false;
 
     const char* imageFilename = nullptr;
     bool seedSet = false;
 
     u32 period = 50;
+    u32 scale = 0;
+    u32 samples = 1;
+    u32 framePeriod = 0;
+    u32 frameScale = 1;
 
     for (i32 i = 1; i < argc; i++) {
         const char* arg = argv[i];
@@ -85,6 +161,54 @@ bool GlobalConfig::setup(int argc, char* argv[]) {
                 return print_usage();
             }
             outputSVG = argv[++i];
+        } else if (is_lopt(arg, "image")) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "genalgo: Missing filename after --image\n");
+                return print_usage();
+            }
+            outputImage = argv[++i];
+        } else if (is_lopt(arg, "scale")) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "genalgo: Missing scale after --scale\n");
+                return print_usage();
+            }
+            if (!to_u32(argv[++i], &scale) || scale == 0) {
+                fprintf(stderr, "genalgo: Invalid scale, must be a positive number\n");
+                return print_usage();
+            }
+        } else if (is_lopt(arg, "supersample")) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "genalgo: Missing number of samples after --supersample\n");
+                return print_usage();
+            }
+            if (!to_u32(argv[++i], &samples) || samples == 0) {
+                fprintf(stderr, "genalgo: Invalid number of samples, must be a positive number\n");
+                return print_usage();
+            }
+        } else if (is_lopt(arg, "timelapse")) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "genalgo: Missing filename after --timelapse\n");
+                return print_usage();
+            }
+            timelapseFilename = argv[++i];
+        } else if (is_lopt(arg, "timelapse-period")) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "genalgo: Missing period after --timelapse-period\n");
+                return print_usage();
+            }
+            if (!to_u32(argv[++i], &framePeriod)) {
+                fprintf(stderr, "genalgo: Invalid period, must be a u32 number\n");
+                return print_usage();
+            }
+        } else if (is_lopt(arg, "timelapse-scale")) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "genalgo: Missing scale after --timelapse-scale\n");
+                return print_usage();
+            }
+            if (!to_u32(argv[++i], &frameScale) || frameScale == 0) {
+                fprintf(stderr, "genalgo: Invalid scale, must be a positive number\n");
+                return print_usage();
+            }
         } else if (is_opt(arg, "gi", "gen-input")) {
             if (i + 1 >= argc) {
                 fprintf(stderr, "genalgo: Missing filename after -gi/--gen-input\n");
@@ -120,6 +244,65 @@ bool GlobalConfig::setup(int argc, char* argv[]) {
                 return print_usage();
             }
             fitnessEngine = argv[++i];
+        } else if (is_opt(arg, "m", "metric")) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "genalgo: Missing metric after -m/--metric\n");
+                return print_usage();
+            }
+            if (!parseFitnessMetric(argv[++i], &fitnessMetric)) {
+                fprintf(stderr, "genalgo: Unknown metric: %s\n", argv[i]);
+                return print_usage();
+            }
+        } else if (is_lopt(arg, "weight-map")) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "genalgo: Missing weight map after --weight-map\n");
+                return print_usage();
+            }
+            if (!parseWeightMap(argv[++i], &weightMap)) {
+                fprintf(stderr, "genalgo: Unknown weight map: %s\n", argv[i]);
+                return print_usage();
+            }
+        } else if (is_lopt(arg, "target-cache")) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "genalgo: Missing directory after --target-cache\n");
+                return print_usage();
+            }
+            targetCacheDir = argv[++i];
+        } else if (is_lopt(arg, "color-jitter")) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "genalgo: Missing jitter after --color-jitter\n");
+                return print_usage();
+            }
+            u32 jitter;
+            if (!to_u32(argv[++i], &jitter) || jitter > 255) {
+                fprintf(stderr, "genalgo: Invalid jitter, must be a number in [0, 255]\n");
+                return print_usage();
+            }
+            colorJitter = jitter;
+        } else if (is_lopt(arg, "refit")) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "genalgo: Missing number of triangles after --refit\n");
+                return print_usage();
+            }
+            u32 triangles;
+            if (!to_u32(argv[++i], &triangles) || triangles > std::numeric_limits<i32>::max()) {
+                fprintf(stderr, "genalgo: Invalid number of triangles, must be a u32 number\n");
+                return print_usage();
+            }
+            refitTriangles = triangles;
+        } else if (is_lopt(arg, "spatial-index")) {
+            spatialIndex = true;
+        } else if (is_lopt(arg, "adaptive-mutation")) {
+            adaptiveMutation = true;
+        } else if (is_lopt(arg, "error-guided")) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "genalgo: Missing probability after --error-guided\n");
+                return print_usage();
+            }
+            if (!to_f64(argv[++i], &errorGuidedChance) || !(errorGuidedChance >= 0 && errorGuidedChance <= 1)) {
+                fprintf(stderr, "genalgo: Invalid probability, must be a number in [0, 1]\n");
+                return print_usage();
+            }
         } else if (is_lopt(arg, "period")) {
             if (i + 1 >= argc) {
                 fprintf(stderr, "genalgo: Missing period after --period\n");
@@ -129,10 +312,67 @@ bool GlobalConfig::setup(int argc, char* argv[]) {
                 fprintf(stderr, "genalgo: Invalid period, must be a u32 number\n");
                 return print_usage();
             }
+        } else if (is_lopt(arg, "trace")) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "genalgo: Missing filename after --trace\n");
+                return print_usage();
+            }
+            traceFilename = argv[++i];
+        } else if (is_lopt(arg, "metrics")) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "genalgo: Missing filename after --metrics\n");
+                return print_usage();
+            }
+            metricsFilename = argv[++i];
+        } else if (is_lopt(arg, "prometheus")) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "genalgo: Missing filename after --prometheus\n");
+                return print_usage();
+            }
+            prometheusFilename = argv[++i];
+        } else if (is_lopt(arg, "prune")) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "genalgo: Missing threshold after --prune\n");
+                return print_usage();
+            }
+            if (!to_f64(argv[++i], &pruneThreshold) || !(pruneThreshold >= 0)) {
+                fprintf(stderr, "genalgo: Invalid threshold, must be a non-negative number\n");
+                return print_usage();
+            }
+            prune = true;
+        } else if (is_lopt(arg, "prune-elites")) {
+            pruneElites = true;
+        } else if (is_lopt(arg, "lineage")) {
+            lineage = true;
+        } else if (is_lopt(arg, "genealogy")) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "genalgo: Missing filename after --genealogy\n");
+                return print_usage();
+            }
+            genealogyFilename = argv[++i];
+            lineage = true;
+        } else if (is_lopt(arg, "front-to-back")) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "genalgo: Missing transmittance after --front-to-back\n");
+                return print_usage();
+            }
+            if (!to_f64(argv[++i], &minTransmittance) || !(minTransmittance >= 0 && minTransmittance < 1)) {
+                fprintf(stderr, "genalgo: Invalid transmittance, must be in [0, 1)\n");
+                return print_usage();
+            }
+            frontToBack = true;
+        } else if (is_lopt(arg, "fixed-point")) {
+            fixedPoint = true;
+        } else if (is_lopt(arg, "perf-counters")) {
+            perfCounters = true;
         } else if (is_lopt(arg, "no-render")) {
             renderDisabled = true;
         } else if (is_lopt(arg, "no-breed")) {
             breedDisabled = true;
+        } else if (is_lopt(arg, "no-cull")) {
+            cullDisabled = true;
+        } else if (is_lopt(arg, "no-batch")) {
+            batchDisabled = true;
         } else if (is_opt(arg, "h", "help")) {
             return print_usage(true);
         } else {
@@ -146,7 +386,12 @@ bool GlobalConfig::setup(int argc, char* argv[]) {
         return print_usage();
     }
 
-    if (!targetImage.load(imageFilename)) {
+    if (fixedPoint && frontToBack) {
+        fprintf(stderr, "genalgo: --fixed-point and --front-to-back can't be combined\n");
+        return print_usage();
+    }
+
+    if (!targetImage.load(imageFilename, weightMap, targetCacheDir)) {
         std::fprintf(stderr, "genalgo: Failed to load image: %s\n", imageFilename);
         return false;
     }
@@ -157,9 +402,16 @@ bool GlobalConfig::setup(int argc, char* argv[]) {
     logPeriod = period;
     renderPeriod = period;
 
+    supersample = samples;
+    timelapseScale = frameScale;
+    timelapsePeriod = framePeriod ? framePeriod : period;
+
     // TODO: No configuration should be hardcoded, maybe load those from a file
     // or from the command line itself.
     loadConstants();
+
+    if (scale)
+        svgScale = scale;
     return true;
 }
 
@@ -200,6 +452,42 @@ void GlobalConfig::loadConstants() {
 
     // Renderer parameters
     renderScale = 1;
+
+    buildMutationTables();
+}
+
+void GlobalConfig::buildMutationTables() {
+    // Same order as Individual::mutate and Triangle::mutate
+    f64 mutations[] = {
+        mutationChanceAdd,
+        mutationChanceRemove,
+        mutationChanceReplace,
+        mutationChanceSwap,
+        mutationChanceMerge,
+        mutationChanceSplit,
+        mutationChanceShape,
+        0
+    };
+    f64 shapeMutations[] = {
+        mutationShapeFineColorChance,
+        mutationShapeFineMoveXChance,
+        mutationShapeFineMoveYChance,
+        mutationShapeFineScaleChance,
+        mutationShapeFineRotateChance,
+        0
+    };
+
+    auto build = [](AliasTable& table, f64 weights[], i32 n, char const* name) {
+        f64 total = 0;
+        for (i32 i = 0; i < n - 1; ++i)
+            total += weights[i];
+        if (total > 1 + 1e-9)
+            fprintf(stderr, "genalgo: The %s probabilities sum to %g > 1, they are normalized\n", name, total);
+        weights[n - 1] = std::max(0.0, 1 - total);
+        table.build(weights, n);
+    };
+    build(mutationTable, mutations, std::size(mutations), "mutation");
+    build(shapeMutationTable, shapeMutations, std::size(shapeMutations), "shape mutation");
 }
 
 GA_NAMESPACE_END
@@ -1,6 +1,8 @@
 #ifndef GENALGO_GLOBAL_CONFIG_HPP
 #define GENALGO_GLOBAL_CONFIG_HPP
 
+#include "AliasTable.hpp"
+#include "FitnessMetric.hpp"
 #include "Image.hpp"
 #include "base.hpp"
 
@@ -21,6 +23,15 @@ struct GlobalConfig {
     const char* outputSVG;
     i32 svgScale;
 
+    // Raster image (PNG/PPM) of the best individual, rendered at svgScale
+    const char* outputImage;
+    i32 supersample;
+
+    // Timelapse of the best individual (Y4M video stream)
+    const char* timelapseFilename;
+    i32 timelapseScale;
+    u32 timelapsePeriod; // Number of generations between frames, 0 if none
+
     // Number of individuals in the population
     i32 populationSize;
 
@@ -34,9 +45,57 @@ struct GlobalConfig {
 
     // Fitness engine
     const char* fitnessEngine;
+    FitnessMetric fitnessMetric;
+    WeightMap weightMap;    // Of the target, for the weighted metrics
+    const char* targetCacheDir; // Of the preprocessed targets, nullptr if disabled
+
+    // Probability that a new triangle is centered where the best individual is far from
+    // the target (see ErrorGuide.hpp), instead of anywhere
+    f64 errorGuidedChance;
+
+    // Maximum random change of each channel of new triangles, from the mean of the target under them
+    i32 colorJitter;
+
+    // Number of random triangles of each child whose color is refit to the optimum (see ColorRefit.hpp)
+    i32 refitTriangles;
+
+    // Whether the individuals keep a spatial index of their triangles (see SpatialIndex.hpp),
+    // used by the merges and the refits instead of scanning all the triangles
+    bool spatialIndex;
+
+    // Whether the probabilities of the mutation operators adapt to their success rates (see
+    // MutationRates.hpp)
+    bool adaptiveMutation;
+
+    // Whether the parents, the mutation operators and the fitness of the children are
+    // recorded (see Lineage.hpp), and the full genealogy output, nullptr if disabled
+    bool lineage;
+    const char* genealogyFilename;
+
+    // Whether the triangles of the best individual contributing at most pruneThreshold to
+    // the error are removed every log period (see Pruner.hpp), and those of the elites too
+    bool prune;
+    f64 pruneThreshold;
+    bool pruneElites;
 
     bool breedDisabled;
 
+    // Whether the engines evaluate all the triangles, instead of only those that can change
+    // the canvas (see FitnessEngine::evaluate)
+    bool cullDisabled;
+
+    // Whether the MT engine evaluates small targets one individual at a time, instead of in
+    // tiles of groups of individuals (see MTFitnessEngine::BATCH_MAX_PIXELS)
+    bool batchDisabled;
+
+    // Whether the CPU engines composite the triangles front to back, stopping at the pixels
+    // whose transmittance is at most minTransmittance (see rasterizer::rasterizeFrontToBack)
+    bool frontToBack;
+    f64 minTransmittance;
+
+    // Whether the CPU engines blend and score in integers (see FixedPoint.hpp)
+    bool fixedPoint;
+
     // Mutation parameters
     //   * Probabilities are mutually exclusive, they must sum to <= 1
     f64 mutationChanceAdd;
@@ -55,6 +114,11 @@ struct GlobalConfig {
     f64 mutationShapeFineScaleChance;
     f64 mutationShapeFineRotateChance;
 
+    // The probabilities above, compiled by buildMutationTables. The last entry of each is
+    // the remaining probability of no mutation.
+    AliasTable mutationTable;
+    AliasTable shapeMutationTable;
+
     // Penalty for each triangle in the individual
     f64 penalty;
 
@@ -66,11 +130,24 @@ struct GlobalConfig {
     // Number of generations between logging
     u32 logPeriod;
 
+    // Chrome trace output of the profiler
+    const char* traceFilename;
+
+    // Machine-readable metrics, written every log period
+    const char* metricsFilename;    // JSON Lines, or CSV with the .csv extension
+    const char* prometheusFilename; // Prometheus textfile collector
+
+    // Sample hardware performance counters in the profiler zones
+    bool perfCounters;
+
     // Seed for the random number generator
     u32 seed; 
 
     bool setup(int argc, char* argv[]);
     void loadConstants();
+
+    // Must be called after changing the mutation probabilities
+    void buildMutationTables();
 };
 
 extern GlobalConfig globalCfg;
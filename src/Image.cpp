@@ -1,146 +1,287 @@
 #include "Image.hpp"
 
+#include "Color.hpp"
+#include "Rasterizer.hpp"
+#include "TargetCache.hpp"
 #include <SFML/Graphics.hpp>
+#include <algorithm>
 #include <cmath>
+#include <cstdio>
 #include <cstring>
+#include <fstream>
 #include <iostream>
+#include <iterator>
 #include <memory>
+#include <vector>
+
+#include <omp.h>
 
 GA_NAMESPACE_BEGIN
 
-Image::Image() noexcept: data(nullptr), width(0), height(0) {}
+Image::Image() noexcept: data(nullptr), weights(nullptr), premultiplied(nullptr), width(0), height(0) {}
 
 Image::Image(unsigned int width, unsigned int height): width(width), height(height) {
     data = new unsigned char[width * height * 4];
     weights = new f64[width * height];
+    premultiplied = new Vec3d[width * height];
 }
 
-// Neighbor-difference-squared
-void Image::computeWeights() {
-    const i32 RADIUS = 5;
+// Sums over a box of (2 * RADIUS + 1)^2 pixels, clipped to the image, of the channels
+// and of their squares. They are computed with separable running sums, so the cost per
+// pixel doesn't depend on the radius: a horizontal pass per row, then a vertical pass
+// that slides over rows and hands the sums of each pixel to visit(x, y, count, s1, s2).
+template <typename F>
+static void boxSums(u8 const* data, i32 width, i32 height, i32 radius, F&& visit) {
+    // Horizontal pass: per channel sums fit in u16, sums of squares in u32
+    std::vector<u16> rowSums(static_cast<std::size_t>(width) * height * 4);
+    std::vector<u32> rowSquares(static_cast<std::size_t>(width) * height);
 
-    auto sums = std::make_unique<f64[]>(width * height);
-    f64 maxSum = 0.0;
+    #pragma omp parallel for schedule(static)
     for (i32 y = 0; y < height; ++y) {
-        for (i32 x = 0; x < width; ++x) {
-            i64 total = 0;
-            i32 numNeighbours = 0;
-            for (i32 dy = -RADIUS; dy <= RADIUS; ++dy) {
-                for (i32 dx = -RADIUS; dx <= RADIUS; ++dx) {
-                    if (dx == 0 && dy == 0) continue;
-                    auto [xN, yN] = std::make_pair(x + dx, y + dy);
-                    if (xN < 0 || xN >= width || yN < 0 || yN >= height) continue;
+        u8 const* row = data + static_cast<std::size_t>(y) * width * 4;
+        u16* sums = rowSums.data() + static_cast<std::size_t>(y) * width * 4;
+        u32* squares = rowSquares.data() + static_cast<std::size_t>(y) * width;
 
-                    ++numNeighbours;
-                    i32 idxN = (yN * width + xN) * 4;
-                    i32 idx = (y * width + x) * 4;
-                    for (i32 i = 0; i < 4; ++i) {
-                        i64 diff = data[idxN + i] - data[idx + i];
-                        total += diff * diff;
-                    }
-                }
+        i32 s1[4] = {0, 0, 0, 0};
+        i32 s2 = 0;
+        auto add = [&](i32 x, i32 sign) {
+            for (i32 c = 0; c < 4; ++c) {
+                i32 v = row[x * 4 + c];
+                s1[c] += sign * v;
+                s2 += sign * v * v;
             }
+        };
 
-            if (numNeighbours > 0) {
-                f64 sum = 1.0 * total / (255 * 255 * numNeighbours);
-                sums[y * width + x] = sum;
-                if (sum > maxSum) {
-                    maxSum = sum;
-                }
-            } else {
-                sums[y * width + x] = 0.0;
+        for (i32 x = 0; x < std::min(radius, width); ++x)
+            add(x, 1);
+        for (i32 x = 0; x < width; ++x) {
+            if (x + radius < width)
+                add(x + radius, 1);
+            if (x - radius - 1 >= 0)
+                add(x - radius - 1, -1);
+
+            for (i32 c = 0; c < 4; ++c)
+                sums[x * 4 + c] = static_cast<u16>(s1[c]);
+            squares[x] = s2;
+        }
+    }
+
+    // Vertical pass, each thread slides over a strip of rows
+    #pragma omp parallel
+    {
+        std::vector<i32> s1(static_cast<std::size_t>(width) * 4, 0);
+        std::vector<i64> s2(width, 0);
+        auto add = [&](i32 y, i32 sign) {
+            u16 const* sums = rowSums.data() + static_cast<std::size_t>(y) * width * 4;
+            u32 const* squares = rowSquares.data() + static_cast<std::size_t>(y) * width;
+            for (i32 i = 0; i < width * 4; ++i)
+                s1[i] += sign * sums[i];
+            for (i32 x = 0; x < width; ++x)
+                s2[x] += sign * static_cast<i64>(squares[x]);
+        };
+
+        i32 threads = omp_get_num_threads();
+        i32 thread = omp_get_thread_num();
+        i32 y0 = static_cast<i32>(static_cast<i64>(height) * thread / threads);
+        i32 y1 = static_cast<i32>(static_cast<i64>(height) * (thread + 1) / threads);
+
+        // Window of y0 - 1, clipped
+        for (i32 y = std::max(0, y0 - radius - 1); y < std::min(height, y0 + radius); ++y)
+            add(y, 1);
+        for (i32 y = y0; y < y1; ++y) {
+            if (y + radius < height)
+                add(y + radius, 1);
+            if (y - radius - 1 >= 0)
+                add(y - radius - 1, -1);
+
+            i32 rows = std::min(height - 1, y + radius) - std::max(0, y - radius) + 1;
+            for (i32 x = 0; x < width; ++x) {
+                i32 columns = std::min(width - 1, x + radius) - std::max(0, x - radius) + 1;
+                visit(x, y, rows * columns, &s1[x * 4], s2[x]);
             }
         }
     }
+}
 
-    // Normalize the weights
+// Sum over the neighbours of the squared difference with the pixel, per neighbour
+static void detailWeights(f64* weights, u8 const* data, i32 width, i32 height) {
+    const i32 RADIUS = 5;
+
+    boxSums(data, width, height, RADIUS, [&](i32 x, i32 y, i32 count, i32 const* s1, i64 s2) {
+        // Sum of (n - p)^2 over the box, the pixel itself adds 0
+        u8 const* pixel = data + (static_cast<std::size_t>(y) * width + x) * 4;
+        i64 total = s2;
+        for (i32 c = 0; c < 4; ++c) {
+            i64 p = pixel[c];
+            total += count * p * p - 2 * p * s1[c];
+        }
+
+        i32 numNeighbours = count - 1;
+        weights[y * width + x] = numNeighbours > 0 ? 1.0 * total / (255 * 255 * numNeighbours) : 0.0;
+    });
+}
+
+// Variance of the channels in the box, summed over the channels
+static void varianceWeights(f64* weights, u8 const* data, i32 width, i32 height) {
+    const i32 RADIUS = 5;
+
+    boxSums(data, width, height, RADIUS, [&](i32 x, i32 y, i32 count, i32 const* s1, i64 s2) {
+        // count^2 * variance = count * sum(v^2) - sum(v)^2, exact in integers
+        i64 total = count * s2;
+        for (i32 c = 0; c < 4; ++c)
+            total -= static_cast<i64>(s1[c]) * s1[c];
+        weights[y * width + x] = 1.0 * total / (255.0 * 255.0 * count * count);
+    });
+}
+
+// Magnitude of the Sobel gradient of the gray image
+static void sobelWeights(f64* weights, u8 const* data, i32 width, i32 height) {
+    static constexpr i32 Gx[3][3] = {
+        {-1, 0, 1},
+        {-2, 0, 2},
+        {-1, 0, 1}
+    };
+
+    static constexpr i32 Gy[3][3] = {
+        {-1, -2, -1},
+        { 0,  0,  0},
+        { 1,  2,  1}
+    };
+
+    #pragma omp parallel for schedule(static)
     for (i32 y = 0; y < height; ++y) {
         for (i32 x = 0; x < width; ++x) {
-            i32 idx = (y * width + x);
-            if (maxSum > 0.0) {
-                // auto value = sums[idx] / maxSum;
-                // weights[idx] = sums[idx];
-                weights[idx] = 0;
-            } 
+            i32 sumX = 0;
+            i32 sumY = 0;
+
+            for (i32 ky = -1; ky <= 1; ++ky) {
+                for (i32 kx = -1; kx <= 1; ++kx) {
+                    i32 xN = x + kx;
+                    i32 yN = y + ky;
+                    if (xN < 0 || xN >= width || yN < 0 || yN >= height) continue;
+
+                    u8 const* n = data + (static_cast<std::size_t>(yN) * width + xN) * 4;
+                    i32 gray = (n[0] + n[1] + n[2]) / 3;
+
+                    sumX += gray * Gx[ky + 1][kx + 1];
+                    sumY += gray * Gy[ky + 1][kx + 1];
+                }
+            }
+
+            weights[y * width + x] = std::sqrt(1.0 * sumX * sumX + 1.0 * sumY * sumY);
         }
     }
 }
 
-// Kernel-based edge detection
-// void Image::computeWeights() {
-//     const i32 KERNEL_SIZE = 3;
-
-//     // Sobel kernels for edge detection
-//     const i32 Gx[KERNEL_SIZE][KERNEL_SIZE] = {
-//         {-1, 0, 1},
-//         {-2, 0, 2},
-//         {-1, 0, 1}
-//     };
-
-//     const i32 Gy[KERNEL_SIZE][KERNEL_SIZE] = {
-//         {-1, -2, -1},
-//         { 0,  0,  0},
-//         { 1,  2,  1}
-//     };
-
-//     auto gradients = std::make_unique<f64[]>(width * height);
-
-//     for (i32 y = 0; y < height; ++y) {
-//         for (i32 x = 0; x < width; ++x) {
-//             f64 sumX = 0.0;
-//             f64 sumY = 0.0;
-
-//             for (i32 ky = -1; ky <= 1; ++ky) {
-//                 for (i32 kx = -1; kx <= 1; ++kx) {
-//                     auto [xN, yN] = std::make_pair(x + kx, y + ky);
-//                     if (xN < 0 || xN >= width || yN < 0 || yN >= height) continue;
-
-//                     i32 idxN = (yN * width + xN) * 4;
-//                     i32 gray = (data[idxN] + data[idxN + 1] + data[idxN + 2]) / 3;
-
-//                     sumX += gray * Gx[ky + 1][kx + 1];
-//                     sumY += gray * Gy[ky + 1][kx + 1];
-//                 }
-//             }
-
-//             gradients[y * width + x] = std::sqrt(sumX * sumX + sumY * sumY);
-//         }
-//     }
-
-//     f64 maxGradient = 0.0;
-//     for (i32 i = 0; i < width * height; ++i) {
-//         if (gradients[i] > maxGradient) {
-//             maxGradient = gradients[i];
-//         }
-//     }
-
-//     for (i32 i = 0; i < width * height; ++i) {
-//         weights[i] = gradients[i] / maxGradient;
-//     }
-// }
-
-bool Image::load(std::string const& filename) {
-    sf::Image sfImage;
-    if (!sfImage.loadFromFile(filename))
+void Image::computeWeights(WeightMap map) {
+    const i32 size = width * height;
+    switch (map) {
+    case WeightMap::none:
+        std::fill(weights, weights + size, 0.0);
+        return;
+    case WeightMap::detail:
+        detailWeights(weights, data, width, height);
+        break;
+    case WeightMap::variance:
+        varianceWeights(weights, data, width, height);
+        break;
+    case WeightMap::sobel:
+        sobelWeights(weights, data, width, height);
+        break;
+    }
+
+    // Normalize the weights to [0, 1]
+    f64 maxWeight = 0.0;
+    #pragma omp parallel for reduction(max: maxWeight)
+    for (i32 i = 0; i < size; ++i)
+        maxWeight = std::max(maxWeight, weights[i]);
+
+    f64 scale = maxWeight > 0.0 ? 1.0 / maxWeight : 0.0;
+    #pragma omp parallel for
+    for (i32 i = 0; i < size; ++i)
+        weights[i] *= scale;
+}
+
+void Image::prepare(WeightMap map) {
+    computeWeights(map);
+    rasterizer::premultiply(premultiplied, reinterpret_cast<Color const*>(data), width * height);
+    integral.build(premultiplied, width, height);
+}
+
+bool Image::load(std::string const& filename, WeightMap weightMap, const char* cacheDir) {
+    if (!cacheDir) {
+        sf::Image sfImage;
+        if (!sfImage.loadFromFile(filename))
+            return false;
+
+        create(sfImage.getSize().x, sfImage.getSize().y);
+        std::memcpy(data, sfImage.getPixelsPtr(), width * height * 4);
+        prepare(weightMap);
+        return true;
+    }
+
+    // The cache is found by the hash of the file, so it doesn't need to be decoded
+    std::ifstream file(filename, std::ios::binary);
+    if (!file)
+        return false;
+    std::vector<char> content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (content.empty())
         return false;
 
-    if (data)
-        delete[] data;
+    u64 hash = hashContent(content.data(), content.size());
+    std::string cachePath = TargetCache::path(cacheDir, hash, weightMap);
+    if (std::unique_ptr<TargetCache> mapped = TargetCache::map(cachePath, hash, weightMap)) {
+        release();
+        width = mapped->getWidth();
+        height = mapped->getHeight();
+        data = mapped->getPixels();
+        weights = mapped->getWeights();
+        premultiplied = mapped->getPremultiplied();
+        integral.assign(mapped->getIntegral(), width, height);
+        cache = std::move(mapped);
+        return true;
+    }
 
-    width = sfImage.getSize().x;
-    height = sfImage.getSize().y;
-    data = new unsigned char[width * height * 4];
-    weights = new f64[width * height];
+    sf::Image sfImage;
+    if (!sfImage.loadFromMemory(content.data(), content.size()))
+        return false;
 
+    create(sfImage.getSize().x, sfImage.getSize().y);
     std::memcpy(data, sfImage.getPixelsPtr(), width * height * 4);
+    prepare(weightMap);
 
-    computeWeights();
+    if (!TargetCache::write(cachePath, hash, weightMap, *this))
+        std::fprintf(stderr, "genalgo: Warning: Failed to write the target cache: %s\n", cachePath.c_str());
     return true;
 }
 
+void Image::create(i32 width, i32 height) {
+    release();
+
+    this->width = width;
+    this->height = height;
+    data = new unsigned char[width * height * 4];
+    weights = new f64[width * height];
+    premultiplied = new Vec3d[width * height];
+}
+
+void Image::release() noexcept {
+    if (!cache) {
+        delete[] data;
+        delete[] weights;
+        delete[] premultiplied;
+    } else {
+        // The integral is in the mapping too
+        integral = IntegralImage();
+    }
+    cache.reset();
+    data = nullptr;
+    weights = nullptr;
+    premultiplied = nullptr;
+}
+
 Image::~Image() {
-    delete[] data;
-    delete[] weights;
+    release();
 }
 
 GA_NAMESPACE_END
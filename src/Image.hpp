@@ -2,10 +2,35 @@
 #define GENALGO_IMAGE_HPP
 
 #include "base.hpp"
+#include "IntegralImage.hpp"
+#include "Vec.hpp"
+#include <memory>
 #include <string>
+#include <string_view>
 
 GA_NAMESPACE_BEGIN
 
+// Importance of each pixel of the target, normalized to [0, 1]. Used by the weighted
+// fitness metrics (and shown by the renderer).
+enum class WeightMap {
+    none,       // All zero
+    detail,     // Mean squared difference with the neighbours in an 11x11 box
+    sobel,      // Magnitude of the Sobel gradient of the gray image
+    variance    // Variance of the channels in an 11x11 box
+};
+
+// Parses the name of a weight map (none, detail, sobel or variance). Returns false if it's unknown.
+inline bool parseWeightMap(std::string_view name, WeightMap* out) {
+    if (name == "none") *out = WeightMap::none;
+    else if (name == "detail") *out = WeightMap::detail;
+    else if (name == "sobel") *out = WeightMap::sobel;
+    else if (name == "variance") *out = WeightMap::variance;
+    else return false;
+    return true;
+}
+
+class TargetCache;
+
 // Image RGBA
 class Image {
 public:
@@ -18,9 +43,20 @@ public:
     Image& operator=(Image&& other) = delete;
 
     Image(u32 width, u32 height);
-    bool load(std::string const& filename);
 
-    void computeWeights();
+    // Loads and prepares the image. With a cache directory, the preprocessed target is
+    // memory-mapped from the cache file of the content of the image, which is written
+    // the first time.
+    bool load(std::string const& filename, WeightMap weightMap = WeightMap::detail, const char* cacheDir = nullptr);
+
+    // Reallocates the image, the pixels are left uninitialized
+    void create(i32 width, i32 height);
+
+    // Computes the weights, the premultiplied target and its integral, after the pixels change
+    void prepare(WeightMap map = WeightMap::detail);
+
+    // Linear in the number of pixels, parallelized over rows
+    void computeWeights(WeightMap map = WeightMap::detail);
 
     i32 getWidth() const noexcept { return width; }
     i32 getHeight() const noexcept { return height; }
@@ -28,10 +64,26 @@ public:
     u8* getData() noexcept { return data; }
     f64* getWeights() noexcept { return weights; }
 
+    // Target as seen by the fitness: RGB blended over black (see Rasterizer.hpp)
+    Vec3d* getPremultiplied() noexcept { return premultiplied; }
+
+    // Summed-area table of the premultiplied target
+    IntegralImage const& getIntegral() const noexcept { return integral; }
+
+    // Cache the image was loaded from, or nullptr
+    TargetCache const* getCache() const noexcept { return cache.get(); }
+
     ~Image();
 private:
+    void release() noexcept;
+
     u8* data;
     f64* weights;
+    Vec3d* premultiplied;
+    IntegralImage integral;
+
+    // If set, the buffers are in its mapping
+    std::unique_ptr<TargetCache> cache;
 
     i32 width;
     i32 height;
@@ -0,0 +1,94 @@
+#include "ImageWriter.hpp"
+
+#include <SFML/Graphics/Image.hpp>
+#include <algorithm>
+#include <cctype>
+#include <string_view>
+
+GA_NAMESPACE_BEGIN
+
+static_assert(sizeof(Color) == 4, "Color must be RGBA");
+
+bool writePPM(std::string const& filename, Color const* pixels, i32 width, i32 height) {
+    std::ofstream stream(filename, std::ios::binary);
+    if (!stream)
+        return false;
+
+    stream << "P6\n" << width << ' ' << height << "\n255\n";
+
+    std::vector<u8> row(3 * static_cast<std::size_t>(width));
+    for (i32 y = 0; y < height; ++y) {
+        for (i32 x = 0; x < width; ++x) {
+            Color c = pixels[static_cast<std::size_t>(y) * width + x];
+            row[3 * x + 0] = c.r;
+            row[3 * x + 1] = c.g;
+            row[3 * x + 2] = c.b;
+        }
+        stream.write(reinterpret_cast<const char*>(row.data()), row.size());
+    }
+
+    return static_cast<bool>(stream);
+}
+
+bool writePNG(std::string const& filename, Color const* pixels, i32 width, i32 height) {
+    // sf::Image doesn't require a window (or a display) to be saved
+    sf::Image image;
+    image.create(width, height, reinterpret_cast<const u8*>(pixels));
+    return image.saveToFile(filename);
+}
+
+static bool hasExtension(std::string const& filename, std::string_view ext) {
+    if (filename.size() < ext.size())
+        return false;
+
+    return std::equal(ext.rbegin(), ext.rend(), filename.rbegin(), [](char a, char b) {
+        return a == std::tolower(static_cast<unsigned char>(b));
+    });
+}
+
+bool writeImage(std::string const& filename, Color const* pixels, i32 width, i32 height) {
+    if (hasExtension(filename, ".ppm"))
+        return writePPM(filename, pixels, width, height);
+    return writePNG(filename, pixels, width, height);
+}
+
+bool Y4MWriter::open(std::string const& filename, i32 width, i32 height, i32 fps) {
+    stream.open(filename, std::ios::binary | std::ios::trunc);
+    if (!stream)
+        return false;
+
+    this->width = width;
+    this->height = height;
+    planes.resize(3 * static_cast<std::size_t>(width) * height);
+
+    // 4:4:4 chroma, so there is no restriction on the frame size
+    stream << "YUV4MPEG2 W" << width << " H" << height << " F" << fps << ":1 Ip A1:1 C444\n";
+    return static_cast<bool>(stream);
+}
+
+bool Y4MWriter::writeFrame(Color const* pixels) {
+    if (!stream)
+        return false;
+
+    std::size_t size = static_cast<std::size_t>(width) * height;
+    u8* Y = planes.data();
+    u8* U = Y + size;
+    u8* V = U + size;
+
+    // BT.601, limited range
+    for (std::size_t i = 0; i < size; ++i) {
+        i32 r = pixels[i].r;
+        i32 g = pixels[i].g;
+        i32 b = pixels[i].b;
+        Y[i] = static_cast<u8>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+        U[i] = static_cast<u8>(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+        V[i] = static_cast<u8>(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+    }
+
+    stream << "FRAME\n";
+    stream.write(reinterpret_cast<const char*>(planes.data()), planes.size());
+    stream.flush();
+    return static_cast<bool>(stream);
+}
+
+GA_NAMESPACE_END
@@ -0,0 +1,43 @@
+#ifndef GENALGO_IMAGEWRITER_HPP
+#define GENALGO_IMAGEWRITER_HPP
+
+#include "base.hpp"
+#include "Color.hpp"
+#include <fstream>
+#include <string>
+#include <vector>
+
+GA_NAMESPACE_BEGIN
+
+// Writes RGBA pixels to a PPM (binary, alpha is dropped) file.
+bool writePPM(std::string const& filename, Color const* pixels, i32 width, i32 height);
+
+// Writes RGBA pixels to a PNG file.
+bool writePNG(std::string const& filename, Color const* pixels, i32 width, i32 height);
+
+// Chooses the format from the extension of the filename (.ppm or .png).
+bool writeImage(std::string const& filename, Color const* pixels, i32 width, i32 height);
+
+// Appends frames to a YUV4MPEG2 (.y4m) stream, which can be encoded directly by
+// most video tools (e.g. ffmpeg -i timelapse.y4m timelapse.mp4).
+class Y4MWriter {
+public:
+    Y4MWriter() noexcept = default;
+
+    Y4MWriter(const Y4MWriter&) = delete;
+    Y4MWriter& operator=(const Y4MWriter&) = delete;
+
+    bool open(std::string const& filename, i32 width, i32 height, i32 fps);
+    bool writeFrame(Color const* pixels);
+
+    bool isOpen() const { return stream.is_open(); }
+private:
+    std::ofstream stream;
+    std::vector<u8> planes;
+    i32 width = 0;
+    i32 height = 0;
+};
+
+GA_NAMESPACE_END
+
+#endif // GENALGO_IMAGEWRITER_HPP
@@ -1,24 +1,76 @@
 #include "Individual.hpp"
 
 #include "globalRNG.hpp"
+#include "ErrorGuide.hpp"
 #include "GlobalConfig.hpp"
+#include "Lineage.hpp"
+#include "SpatialIndex.hpp"
+#include "TileLayout.hpp"
 #include <algorithm>
+#include <chrono>
+#include <cmath>
 #include "JSONSerializer/vector_serializer.hpp"
 #include "JSONDeserializer/vector_deserializer.hpp"
 #include <iomanip>
 #include <iostream>
+#include <iterator>
 #include <ostream>
 
 GA_NAMESPACE_BEGIN
 
+// Sets the RGB of the triangle to the mean of the target under it, with a random jitter
+// of up to colorJitter per channel. The alpha is left unchanged.
+static void initColor(Triangle& t) {
+    Vec3d mean = globalCfg.targetImage.getIntegral().triangleMean(t);
+    i32 jitter = globalCfg.colorJitter;
+    auto channel = [&](f64 value) {
+        return static_cast<u8>(std::clamp<i32>(std::lround(value) + randomI32(-jitter, jitter), 0, 255));
+    };
+    t.color.r = channel(mean.x);
+    t.color.g = channel(mean.y);
+    t.color.b = channel(mean.z);
+}
+
+// Triangle around a point where the best individual is far from the target, with
+// vertices up to a quarter of the image away from it
+static Triangle guidedTriangle(Point<i32> center) {
+    i32 width = globalCfg.targetImage.getWidth();
+    i32 height = globalCfg.targetImage.getHeight();
+    i32 maxRadius = std::max(TILE_SIZE, std::min(width, height) / 4);
+
+    std::uniform_int_distribution<u8> alphaDist(30, 255);
+
+    while (true) {
+        i32 radius = randomI32(TILE_SIZE / 2, maxRadius);
+        auto vertex = [&]() {
+            return Point<i32>{std::clamp(center.x + randomI32(-radius, radius), 0, width - 1),
+                              std::clamp(center.y + randomI32(-radius, radius), 0, height - 1)};
+        };
+
+        Triangle t;
+        t.a = vertex();
+        t.b = vertex();
+        t.c = vertex();
+        t.color.a = alphaDist(globalRNG);
+
+        if (t.area() < 10)
+            continue;
+        initColor(t);
+        return t;
+    }
+}
+
 static Triangle randomTriangle() {
+    Point<i32> center;
+    if (globalCfg.errorGuidedChance > 0 && randomF64(0, 1) < globalCfg.errorGuidedChance && errorGuide.sample(&center))
+        return guidedTriangle(center);
+
     while (true) {
         i32 width = globalCfg.targetImage.getWidth();
         i32 height = globalCfg.targetImage.getHeight();
 
         std::uniform_int_distribution<i32> xDist(0, width - 1);
         std::uniform_int_distribution<i32> yDist(0, height - 1);
-        std::uniform_int_distribution<u8> colorDist(0, 255);
         std::uniform_int_distribution<u8> alphaDist(30, 255);
 
         Triangle t;
@@ -28,13 +80,11 @@ static Triangle randomTriangle() {
         t.b.y = yDist(globalRNG);
         t.c.x = xDist(globalRNG);
         t.c.y = yDist(globalRNG);
-        t.color.r = colorDist(globalRNG);
-        t.color.g = colorDist(globalRNG);
-        t.color.b = colorDist(globalRNG);
         t.color.a = alphaDist(globalRNG);
 
         if (t.area() < 10)
             continue;
+        initColor(t);
 
         // auto [smallest, largest] = t.getAnglePair();
         // if (smallest >= 20 * M_PI / 180) {
@@ -92,27 +142,115 @@ static Triangle randomTriangle() {
 //     return t;
 // }
 
+// Number of candidates of a merge when the spatial index is enabled
+constexpr i32 MERGE_NEIGHBOURS = 8;
+
+// Index i < n with probability weight(i) / sum of the weights, in O(n) without allocating
 template<typename F>
-static i32 select(i32 n, F&& f) {
-    std::vector<std::pair<double, i32>> probs;
-    probs.reserve(n);
+static i32 select(i32 n, F&& weight) {
+    thread_local std::vector<f64> weights;
+    weights.resize(n);
 
     f64 total = 0;
     for (i32 i = 0; i < n; i++) {
-        std::pair<double, i32> p = f(i);
-
-        probs.emplace_back(p);
-        total += p.first;
+        weights[i] = weight(i);
+        total += weights[i];
     }
 
     f64 prob = randomF64(0, total);
     i32 i = 0;
-    while (prob > probs[i].first) {
-        prob -= probs[i].first;
+    while (i < n - 1 && prob > weights[i]) {
+        prob -= weights[i];
         i++;
     }
+    return i;
+}
+
+// Degenerate and fully transparent triangles count as 1 pixel and alpha 1, so weights stay finite
+static f64 removalWeight(Triangle const& t) {
+    return 1.0 / (std::sqrt(std::max<i64>(t.area(), 1)) * std::max<i32>(t.color.a, 1));
+}
+
+Individual::Individual(Individual const& other) {
+    *this = other;
+}
+
+Individual& Individual::operator=(Individual const& other) {
+    if (this == &other)
+        return *this;
+
+    triangles = other.triangles;
+    index_merge = other.index_merge;
+    removalWeightsValid = other.removalWeightsValid;
+    if (removalWeightsValid)
+        removalWeights = other.removalWeights;
+    spatialIndexValid = other.spatialIndexValid;
+    if (spatialIndexValid)
+        spatialIndex = other.spatialIndex;
+    appliedMutations = other.appliedMutations;
+    mutationSequence = other.mutationSequence;
+    mutationCount = other.mutationCount;
+    fitness = other.fitness;
+    weightedFitness = other.weightedFitness;
+    return *this;
+}
+
+i32 Individual::selectRemoval() {
+    if (!removalWeightsValid) {
+        removalWeights.build(size(), [&](i32 i) { return removalWeight(triangles[i]); });
+        removalWeightsValid = true;
+    }
+    removalWeights.refresh();
+    return removalWeights.sample(randomF64(0, removalWeights.total()));
+}
+
+void Individual::updateRemovalWeight(i32 index) {
+    if (removalWeightsValid)
+        removalWeights.set(index, removalWeight(triangles[index]));
+}
+
+void Individual::insertTriangle(i32 index, Triangle const& triangle) {
+    triangles.insert(triangles.begin() + index, triangle);
+    if (removalWeightsValid)
+        removalWeights.insert(index, removalWeight(triangle));
+    if (spatialIndexValid)
+        spatialIndex.insert(index, triangle);
+}
+
+void Individual::eraseTriangle(i32 index) {
+    triangles.erase(triangles.begin() + index);
+    if (removalWeightsValid)
+        removalWeights.erase(index);
+    if (spatialIndexValid)
+        spatialIndex.erase(index);
+}
 
-    return probs[i].second;
+void Individual::updateTriangle(i32 index) {
+    updateRemovalWeight(index);
+    if (spatialIndexValid)
+        spatialIndex.update(index, triangles[index]);
+}
+
+void Individual::erase(i32 index) {
+    eraseTriangle(index);
+
+    if (index_merge > index)
+        index_merge = std::max(-1, index_merge - 1);
+    else if (index_merge == index)
+        index_merge = -1;
+}
+
+void Individual::setColor(i32 index, Color const& color) {
+    triangles[index].color = color;
+    updateRemovalWeight(index);
+}
+
+SpatialIndex const& Individual::getSpatialIndex() {
+    if (!spatialIndexValid) {
+        spatialIndex.build(triangles, globalCfg.targetImage.getWidth(), globalCfg.targetImage.getHeight());
+        spatialIndexValid = true;
+    }
+    return spatialIndex;
 }
 
 bool Individual::mutateAdd() {
@@ -123,7 +261,7 @@ bool Individual::mutateAdd() {
 
     auto triangle = randomTriangle();
     i32 id = randomI32(0, size());
-    triangles.insert(begin() + id, triangle);
+    insertTriangle(id, triangle);
 
     // triangles.push_back(triangle);
     return true;
@@ -133,16 +271,7 @@ bool Individual::mutateRemove() {
     if (triangles.size() <= 1)
         return mutateReplace();
 
-    i32 id = select(size(), [&](i32 i) {
-        f64 prob = 1.0 / (std::sqrt(triangles[i].area()) * triangles[i].color.a);
-        return std::make_pair(prob, i);
-    });
-    triangles.erase(begin() + id);
-
-    if (index_merge > id)
-        index_merge = std::max(-1, index_merge - 1);
-    else if (index_merge == id)
-        index_merge = -1;
+    erase(selectRemoval());
     return true;
 }
 
@@ -150,16 +279,12 @@ bool Individual::mutateReplace() {
     if (triangles.empty())
         return false;
 
-    i32 i = select(triangles.size(), [&](i32 i) {
-        f64 prob = 1.0 / (std::sqrt(triangles[i].area()) * triangles[i].color.a);
-
-        return std::make_pair(prob, i);
-    });
-    
+    i32 i = selectRemoval();
 
     if (index_merge == i)
         index_merge = -1;
     triangles[i] = randomTriangle();
+    updateTriangle(i);
     // i32 j = randomI32(0, size() - 1);
     // triangles.erase(begin() + i);
     // triangles.insert(begin() + j, randomTriangle());
@@ -182,6 +307,10 @@ bool Individual::mutateSwap() {
         index_merge = i;
 
     swap(triangles[i], triangles[j]);
+    updateRemovalWeight(i);
+    updateRemovalWeight(j);
+    if (spatialIndexValid)
+        spatialIndex.swap(i, j);
     return true;
 }
 
@@ -198,24 +327,33 @@ bool Individual::mutateMerge() {
     // }
     // std::cout << "Collisions: " << count << " of " << triangles.size() - 1 << " (" << 100.0 * count / (triangles.size() - 1) << "%)\n";
 
-    i32 j = select(size() - 1,
-        [&](i32 j) {
+    // Triangles with the same center count as 1 pixel apart
+    i32 j;
+    if (globalCfg.spatialIndex) {
+        // Among the nearest ones only
+        thread_local std::vector<i32> neighbours;
+        Triangle const& t = triangles[i];
+        getSpatialIndex().nearest((t.a + t.b + t.c) / 3, MERGE_NEIGHBOURS, neighbours, i);
+        j = neighbours[select(static_cast<i32>(neighbours.size()), [&](i32 k) {
+            return 1.0 / std::sqrt(std::max<i64>(t.squareDistance(triangles[neighbours[k]]), 1));
+        })];
+    } else {
+        j = select(size() - 1, [&](i32 j) {
             if (j >= i) ++j;
-
-            f64 prob = 1.0 / std::sqrt(triangles[i].squareDistance(triangles[j]));
-            return std::make_pair(prob, j);
-        }
-    );
+            return 1.0 / std::sqrt(std::max<i64>(triangles[i].squareDistance(triangles[j]), 1));
+        });
+        if (j >= i) ++j;
+    }
 
     // triangles[i].merge(triangles[j]);
     // triangles.erase(begin() + j);
 
     // FIGHT!
     if (triangles[i].area() < triangles[j].area()) {
-        triangles.erase(begin() + i);
+        eraseTriangle(i);
     }
     else {
-        triangles.erase(begin() + j);
+        eraseTriangle(j);
     }
 
     return true;
@@ -229,7 +367,9 @@ bool Individual::mutateSplit() {
     auto [triangle1, triangle2] = triangles[i].split();
     // auto& T = randomI32(0, 1) ? triangle1 : triangle2;
     auto& T = triangle1.area() > triangle2.area() ? triangle1 : triangle2;
+    initColor(T);
     triangles[i] = T;
+    updateTriangle(i);
     return true;
 }
 
@@ -242,41 +382,44 @@ bool Individual::mutateShape() {
     for (i32 j = 0; j < 2; j++) {
         mutated |= triangles[i].mutate();
     }
+    updateTriangle(i);
     return mutated;
 }
 
 bool Individual::mutate() {
-    f64 prob = randomF64(0, 1);
-
-    if (prob < globalCfg.mutationChanceAdd)
-        return mutateAdd();
-    prob -= globalCfg.mutationChanceAdd;
-    
-    if (prob < globalCfg.mutationChanceRemove)
-        return mutateRemove();
-    prob -= globalCfg.mutationChanceRemove;
-
-    if (prob < globalCfg.mutationChanceReplace)
-        return mutateReplace();
-    prob -= globalCfg.mutationChanceReplace;
-    
-    if (prob < globalCfg.mutationChanceSwap)
-        return mutateSwap();
-    prob -= globalCfg.mutationChanceSwap;
-
-    if (prob < globalCfg.mutationChanceMerge)
-        return mutateMerge();
-    prob -= globalCfg.mutationChanceMerge;
+    // Same order as GlobalConfig::buildMutationTables, the last one is no mutation
+    static constexpr bool (Individual::*operators[])() = {
+        &Individual::mutateAdd,
+        &Individual::mutateRemove,
+        &Individual::mutateReplace,
+        &Individual::mutateSwap,
+        &Individual::mutateMerge,
+        &Individual::mutateSplit,
+        &Individual::mutateShape
+    };
+
+    if (globalCfg.mutationTable.empty())
+        return false;
+    i32 i = globalCfg.mutationTable.sample(randomU32());
+    if (i >= static_cast<i32>(std::size(operators)))
+        return false;
 
-    if (prob < globalCfg.mutationChanceSplit)
-        return mutateSplit();
-    prob -= globalCfg.mutationChanceSplit;
-    
-    if (prob < globalCfg.mutationChanceShape)
-        return mutateShape();
-    prob -= globalCfg.mutationChanceShape;
+    bool mutated;
+    if (globalCfg.lineage) {
+        auto start = std::chrono::steady_clock::now();
+        mutated = (this->*operators[i])();
+        lineage.addCost(i, std::chrono::duration<f64>(std::chrono::steady_clock::now() - start).count());
+    } else {
+        mutated = (this->*operators[i])();
+    }
+    if (!mutated)
+        return false;
 
-    return false;
+    appliedMutations |= 1u << i;
+    if (mutationCount < MAX_MUTATION_SEQUENCE)
+        mutationSequence |= static_cast<u64>(i) << (4 * mutationCount);
+    ++mutationCount;
+    return true;
 }
 
 Individual Individual::crossover(Individual const& other) const {
@@ -313,8 +456,29 @@ Individual Individual::crossover(Individual const& other) const {
                 child.index_merge = child.size();
             child.push_back(other[other.size() - i]); 
         }
+
+        // The removal weights and the index of the child are the ones of this parent less
+        // the triangles it doesn't take, rather than a rebuild on the first use
+        if (removalWeightsValid) {
+            child.removalWeights = removalWeights;
+            child.removalWeights.truncate(sz_l);
+            for (i32 i = sz_l; i < child.size(); i++) {
+                i32 j = other.size() - child.size() + i;
+                f64 weight = other.removalWeightsValid ? other.removalWeights.weight(j) : removalWeight(other[j]);
+                child.removalWeights.insert(i, weight);
+            }
+            child.removalWeightsValid = true;
+        }
+        if (spatialIndexValid) {
+            child.spatialIndex = spatialIndex;
+            child.spatialIndex.truncate(sz_l);
+            for (i32 i = sz_l; i < child.size(); i++)
+                child.spatialIndex.insert(i, child.triangles[i]);
+            child.spatialIndexValid = true;
+        }
     }
 
+    child.clearAppliedMutations();
     while (!child.mutate()) {}
 
     while (dist(globalRNG) < 0.5)
@@ -329,6 +493,7 @@ void serialize(JSONSerializerState& state, Individual const& self) {
 
 void deserialize(JSONDeserializerState& state, Individual& self) {
     state.consume(self.triangles);
+    self.invalidate();
 }
 
 void Individual::toSVG(std::ostream& os) const {
@@ -2,6 +2,8 @@
 #define GENALGO_INDIVIDUAL_HPP
 
 #include "base.hpp"
+#include "FenwickTree.hpp"
+#include "SpatialIndex.hpp"
 #include "Triangle.hpp"
 #include <vector>
 
@@ -10,12 +12,14 @@ GA_NAMESPACE_BEGIN
 class Individual {
 public:
     Individual() noexcept = default;
-    Individual(Individual const& other) noexcept = default;
     Individual(Individual&& other) noexcept = default;
-
-    Individual& operator=(Individual const& other) noexcept = default;
     Individual& operator=(Individual&& other) noexcept = default;
 
+    // Copies get the spatial index and the removal weights only if they are up to date:
+    // individuals are copied for every child and elite
+    Individual(Individual const& other);
+    Individual& operator=(Individual const& other);
+
     bool mutateAdd();
     bool mutateRemove();
     bool mutateReplace();
@@ -32,22 +36,48 @@ public:
     void setFitness(f64 fitness) noexcept { this->fitness = fitness; }
     void setWeightedFitness(f64 weightedFitness) noexcept { this->weightedFitness = weightedFitness; }
 
-    auto begin() noexcept { return triangles.begin(); }
-    auto end() noexcept { return triangles.end(); }
+    // Bit i is set if the i-th operator of mutate changed the individual since it was bred
+    u32 getAppliedMutations() const noexcept { return appliedMutations; }
+    void clearAppliedMutations() noexcept {
+        appliedMutations = 0;
+        mutationSequence = 0;
+        mutationCount = 0;
+    }
+
+    // Operators of mutate that changed the individual since it was bred, in order, 4 bits
+    // each from the low bits. Only the first MAX_MUTATION_SEQUENCE are kept, the count is
+    // the total.
+    static constexpr i32 MAX_MUTATION_SEQUENCE = 16;
+    u64 getMutationSequence() const noexcept { return mutationSequence; }
+    i32 getMutationCount() const noexcept { return mutationCount; }
+
+    // The non-const accessors invalidate the removal weights and the spatial index, since
+    // triangles may change
+    auto begin() noexcept { invalidate(); return triangles.begin(); }
+    auto end() noexcept { invalidate(); return triangles.end(); }
 
     auto begin() const noexcept { return triangles.begin(); }
     auto end() const noexcept { return triangles.end(); }
 
-    Triangle& operator[](std::size_t index) noexcept { return triangles[index]; }
+    Triangle& operator[](std::size_t index) noexcept { invalidate(); return triangles[index]; }
     Triangle const& operator[](std::size_t index) const noexcept { return triangles[index]; }
 
+    // Changes the color of a triangle, keeping the spatial index
+    void setColor(i32 index, Color const& color);
+
     i32 size() const noexcept { return static_cast<i32>(triangles.size()); }
-    void resize(i32 size) { triangles.resize(size); }
+    void resize(i32 size) { invalidate(); triangles.resize(size); }
     void reserve(i32 size) { triangles.reserve(size); }
-    void clear() noexcept { triangles.clear(); }
+    void clear() noexcept { invalidate(); triangles.clear(); }
+
+    void push_back(Triangle const& triangle) { invalidate(); triangles.push_back(triangle); }
+    void push_back(Triangle&& triangle) { invalidate(); triangles.push_back(triangle); } 
+
+    // Keeps the removal weights and the spatial index
+    void erase(i32 index);
 
-    void push_back(Triangle const& triangle) { triangles.push_back(triangle); }
-    void push_back(Triangle&& triangle) { triangles.push_back(triangle); } 
+    // Built on first use after the triangles were changed through the accessors
+    SpatialIndex const& getSpatialIndex();
 
     friend void serialize(JSONSerializerState& state, Individual const& self);
     friend void deserialize(JSONDeserializerState& state, Individual& self);
@@ -55,7 +85,31 @@ public:
     void toSVG(std::ostream& os) const;
     i32 index_merge = -1;
 private:
+    // Index of a triangle to remove or replace, small and transparent ones first, in O(log n),
+    // or O(n) after triangles were inserted or erased
+    i32 selectRemoval();
+    void updateRemovalWeight(i32 index);
+
+    // Keep the removal weights and the spatial index up to date
+    void insertTriangle(i32 index, Triangle const& triangle);
+    void eraseTriangle(i32 index);
+    void updateTriangle(i32 index);
+
+    void invalidate() noexcept { removalWeightsValid = false; spatialIndexValid = false; }
+
     std::vector<Triangle> triangles;
+
+    // Removal weights of the triangles, kept up to date by the mutations once built. The
+    // tree is rebuilt from the weights by the next selection after insertions and removals.
+    FenwickTree removalWeights;
+    bool removalWeightsValid = false;
+
+    // Kept up to date by the mutations once built, only used if globalCfg.spatialIndex is set
+    SpatialIndex spatialIndex;
+    bool spatialIndexValid = false;
+    u32 appliedMutations = 0;
+    u64 mutationSequence = 0;
+    i32 mutationCount = 0;
     f64 fitness = 1e18;
     f64 weightedFitness = 1e18;
 };
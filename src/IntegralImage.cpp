@@ -0,0 +1,85 @@
+#include "IntegralImage.hpp"
+
+#include "Triangle.hpp"
+#include <algorithm>
+#include <utility>
+
+GA_NAMESPACE_BEGIN
+
+void IntegralImage::build(Vec3d const pixels[], i32 width, i32 height) {
+    this->width = width;
+    this->height = height;
+    sums.assign(static_cast<std::size_t>(width + 1) * (height + 1), Vec3d{0, 0, 0});
+
+    for (i32 y = 0; y < height; ++y) {
+        Vec3d row {0, 0, 0};
+        Vec3d const* above = &sums[static_cast<std::size_t>(y) * (width + 1)];
+        Vec3d* current = &sums[static_cast<std::size_t>(y + 1) * (width + 1)];
+        for (i32 x = 0; x < width; ++x) {
+            row += pixels[y * width + x];
+            current[x + 1] = above[x + 1] + row;
+        }
+    }
+    assigned = nullptr;
+}
+
+void IntegralImage::assign(Vec3d const sums[], i32 width, i32 height) noexcept {
+    this->width = width;
+    this->height = height;
+    this->sums.clear();
+    assigned = sums;
+}
+
+// Rounds towards negative infinity
+static i64 floorDiv(i64 a, i64 b) {
+    i64 q = a / b;
+    return (a % b != 0 && (a < 0) != (b < 0)) ? q - 1 : q;
+}
+
+Vec3d IntegralImage::triangleMean(Triangle const& t) const noexcept {
+    i32 minX = std::clamp(std::min({t.a.x, t.b.x, t.c.x}), 0, width - 1);
+    i32 minY = std::clamp(std::min({t.a.y, t.b.y, t.c.y}), 0, height - 1);
+    i32 maxX = std::clamp(std::max({t.a.x, t.b.x, t.c.x}), 0, width - 1);
+    i32 maxY = std::clamp(std::max({t.a.y, t.b.y, t.c.y}), 0, height - 1);
+
+    // pointInTriangle covers (x, y) if the signs of the three edge functions are all negative,
+    // or all non-negative. On a row each edge function is A x + B, so each case is a span
+    // of the row, computed exactly in integers.
+    Point<i32> const edges[3][2] = {{t.a, t.b}, {t.b, t.c}, {t.c, t.a}};
+    Vec3d total {0, 0, 0};
+    i64 count = 0;
+    for (i32 y = minY; y <= maxY; ++y) {
+        i64 negativeLo = minX, negativeHi = maxX;
+        i64 positiveLo = minX, positiveHi = maxX;
+        for (auto const& [p, q] : edges) {
+            i64 A = p.y - q.y;
+            i64 B = -static_cast<i64>(q.x) * A - static_cast<i64>(p.x - q.x) * (y - q.y);
+            if (A > 0) {
+                negativeHi = std::min(negativeHi, floorDiv(-B - 1, A));
+                positiveLo = std::max(positiveLo, -floorDiv(B, A));
+            } else if (A < 0) {
+                negativeLo = std::max(negativeLo, floorDiv(-B, A) + 1);
+                positiveHi = std::min(positiveHi, floorDiv(-B, A));
+            } else if (B < 0) {
+                positiveHi = positiveLo - 1;
+            } else {
+                negativeHi = negativeLo - 1;
+            }
+        }
+
+        for (auto [lo, hi] : {std::pair{negativeLo, negativeHi}, std::pair{positiveLo, positiveHi}}) {
+            if (lo > hi)
+                continue;
+            total += boxSum(static_cast<i32>(lo), y, static_cast<i32>(hi), y);
+            count += hi - lo + 1;
+        }
+    }
+
+    if (count == 0) {
+        count = static_cast<i64>(maxX - minX + 1) * (maxY - minY + 1);
+        total = boxSum(minX, minY, maxX, maxY);
+    }
+    return total / static_cast<f64>(count);
+}
+
+GA_NAMESPACE_END
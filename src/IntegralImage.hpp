@@ -0,0 +1,49 @@
+#ifndef GENALGO_INTEGRALIMAGE_HPP
+#define GENALGO_INTEGRALIMAGE_HPP
+
+#include "base.hpp"
+#include "Vec.hpp"
+#include <vector>
+
+GA_NAMESPACE_BEGIN
+
+struct Triangle;
+
+// Summed-area table of an RGB image: sum(x, y) is the sum of the pixels above and to the
+// left of (x, y), excluded. The sum over any box is then 4 lookups, and the sum over the
+// pixels covered by a triangle 4 lookups per row.
+class IntegralImage {
+public:
+    void build(Vec3d const pixels[], i32 width, i32 height);
+
+    // Uses a table built earlier, of (width + 1) * (height + 1) sums (e.g. from the target
+    // cache), which must outlive the object or the next build
+    void assign(Vec3d const sums[], i32 width, i32 height) noexcept;
+
+    // The (width + 1) * (height + 1) sums, row-major
+    Vec3d const* data() const noexcept { return assigned ? assigned : sums.data(); }
+
+    // Sum over the pixels x0 <= x <= x1, y0 <= y <= y1, which must be within the image
+    Vec3d boxSum(i32 x0, i32 y0, i32 x1, i32 y1) const noexcept {
+        return sum(x1 + 1, y1 + 1) - sum(x0, y1 + 1) - sum(x1 + 1, y0) + sum(x0, y0);
+    }
+
+    // Mean over the pixels covered by the triangle (see rasterizer::pointInTriangle), or
+    // over its bounding box if it doesn't cover any pixel
+    Vec3d triangleMean(Triangle const& t) const noexcept;
+
+    bool empty() const noexcept { return !assigned && sums.empty(); }
+private:
+    Vec3d const& sum(i32 x, i32 y) const noexcept {
+        return data()[static_cast<std::size_t>(y) * (width + 1) + x];
+    }
+
+    // Sums of the last build, unless other ones were assigned
+    std::vector<Vec3d> sums;
+    Vec3d const* assigned = nullptr;
+    i32 width = 0, height = 0;
+};
+
+GA_NAMESPACE_END
+
+#endif // GENALGO_INTEGRALIMAGE_HPP
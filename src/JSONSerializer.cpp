@@ -1,5 +1,7 @@
 #include "JSONSerializer.hpp"
 
+#include <charconv>
+#include <cmath>
 #include <iostream>
 #include <vector>
 
@@ -64,6 +66,26 @@ template void JSONSerializerState::serialize_number<u32>(u32 value);
 template void JSONSerializerState::serialize_number<i64>(i64 value);
 template void JSONSerializerState::serialize_number<u64>(u64 value);
 
+void JSONSerializerState::serialize_float(f64 value) {
+    begin_return();
+
+    // JSON has no representation for NaN and infinities
+    if (!std::isfinite(value)) {
+        os << "null";
+        return;
+    }
+
+    // Shortest representation that round-trips
+    char buffer[32];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    os.write(buffer, result.ptr - buffer);
+}
+
+void JSONSerializerState::serialize_bool(bool value) {
+    begin_return();
+    os << (value ? "true" : "false");
+}
+
 void JSONSerializerState::serialize_string(std::string_view value) {
     begin_return();
     
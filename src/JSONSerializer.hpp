@@ -47,6 +47,8 @@ public:
 
     template<std::integral T>
     void serialize_number(T value);
+    void serialize_float(f64 value);
+    void serialize_bool(bool value);
     void serialize_string(std::string_view value);
     void serialize_null();
     JSONObjectBuilder serialize_object();
@@ -113,6 +115,15 @@ inline void serialize(JSONSerializerState& state, T value) {
     state.serialize_number(value);
 }
 
+inline void serialize(JSONSerializerState& state, bool value) {
+    state.serialize_bool(value);
+}
+
+template<std::floating_point T>
+inline void serialize(JSONSerializerState& state, T value) {
+    state.serialize_float(value);
+}
+
 inline void serialize(JSONSerializerState& state, std::string_view value) {
     state.serialize_string(value);
 }
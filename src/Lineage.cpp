@@ -0,0 +1,112 @@
+#include "Lineage.hpp"
+
+#include <algorithm>
+
+GA_NAMESPACE_BEGIN
+
+Lineage lineage;
+
+Lineage::~Lineage() {
+    if (file)
+        std::fclose(file);
+}
+
+bool Lineage::open(const char* filename) {
+    file = std::fopen(filename, "w");
+    if (!file)
+        return false;
+    std::fprintf(file, "generation,index,parent1,parent2,operators,parent_fitness,fitness\n");
+    return !std::ferror(file);
+}
+
+LineageRecord& Lineage::slot(i64 generation, i32 index) noexcept {
+    return ring[(generation % RING_GENERATIONS) * populationSize + index];
+}
+
+void Lineage::recordChild(i32 index, i32 parent1, i32 parent2, f64 parentFitness, Individual const& child) {
+    // The ring buffer is sized by the first evaluation
+    if (index < 0 || index >= populationSize)
+        return;
+
+    LineageRecord& record = slot(lastGeneration + 1, index);
+    record.generation = lastGeneration + 1;
+    record.parent1 = parent1;
+    record.parent2 = parent2;
+    record.operators = child.getMutationSequence();
+    record.operatorCount = child.getMutationCount();
+    record.parentFitness = parentFitness;
+    record.fitness = 0;
+}
+
+void Lineage::evaluate(std::vector<Individual> const& individuals, i64 generation) {
+    const i32 size = static_cast<i32>(individuals.size());
+    if (size != populationSize) {
+        populationSize = size;
+        ring.assign(static_cast<std::size_t>(RING_GENERATIONS) * size, LineageRecord{});
+    }
+
+    bestIndex = -1;
+    for (i32 i = 0; i < size; ++i) {
+        f64 fitness = individuals[i].getWeightedFitness();
+        if (bestIndex < 0 || fitness < individuals[bestIndex].getWeightedFitness())
+            bestIndex = i;
+        LineageRecord& record = slot(generation, i);
+
+        // Not bred since the last evaluation: initial or loaded population
+        if (record.generation != generation) {
+            record = LineageRecord{};
+            record.generation = generation;
+            record.parentFitness = fitness;
+        }
+        record.fitness = fitness;
+
+        i32 count = std::min(record.operatorCount, Individual::MAX_MUTATION_SEQUENCE);
+        for (i32 k = 0; k < count; ++k) {
+            OperatorStats& stats = period[(record.operators >> (4 * k)) & 0xF];
+            ++stats.applications;
+            stats.improvements += fitness < record.parentFitness;
+            stats.fitnessDelta += fitness - record.parentFitness;
+        }
+
+        if (file) {
+            std::fprintf(file, "%lld,%d,%d,%d,", static_cast<long long>(generation), i,
+                    record.parent1, record.parent2);
+            for (i32 k = 0; k < count; ++k) {
+                std::fprintf(file, "%s%s", k ? "+" : "",
+                        MutationRates::operatorName((record.operators >> (4 * k)) & 0xF));
+            }
+            std::fprintf(file, ",%.17g,%.17g\n", record.parentFitness, fitness);
+        }
+    }
+    lastGeneration = generation;
+}
+
+LineageRecord const* Lineage::find(i64 generation, i32 index) const noexcept {
+    if (index < 0 || index >= populationSize || generation < 0 || generation > lastGeneration + 1
+        || generation <= lastGeneration + 1 - RING_GENERATIONS)
+        return nullptr;
+
+    LineageRecord const& record = ring[(generation % RING_GENERATIONS) * populationSize + index];
+    return record.generation == generation ? &record : nullptr;
+}
+
+i32 Lineage::eliteAge(i32 index) const noexcept {
+    i32 age = 0;
+    LineageRecord const* record = find(lastGeneration, index);
+    while (record && record->parent1 >= 0 && record->parent2 < 0) {
+        ++age;
+        record = find(record->generation - 1, record->parent1);
+    }
+    return age;
+}
+
+OperatorReport Lineage::collect() noexcept {
+    if (file)
+        std::fflush(file);
+
+    OperatorReport report = period;
+    period = {};
+    return report;
+}
+
+GA_NAMESPACE_END
@@ -0,0 +1,87 @@
+#ifndef GENALGO_LINEAGE_HPP
+#define GENALGO_LINEAGE_HPP
+
+#include "base.hpp"
+#include "Individual.hpp"
+#include "MutationRates.hpp"
+#include <array>
+#include <cstdio>
+#include <vector>
+
+GA_NAMESPACE_BEGIN
+
+// How an individual was bred, and how it scored
+struct LineageRecord {
+    i64 generation = -1;    // In which it was evaluated
+    i32 parent1 = -1;       // Indices in the population of the previous generation, -1 if
+    i32 parent2 = -1;       // none. Elites only have parent1, founders have none.
+    u64 operators = 0;      // See Individual::getMutationSequence
+    i32 operatorCount = 0;
+    f64 parentFitness = 0;  // Best weighted fitness of the parents
+    f64 fitness = 0;        // Weighted fitness
+};
+
+// Statistics of a mutation operator over a log period. A child mutated by several
+// operators credits its fitness delta to each of them.
+struct OperatorStats {
+    i64 applications = 0;
+    i64 improvements = 0;   // Children better than their best parent
+    f64 fitnessDelta = 0;   // Sum of (child - best parent), negative is better
+    f64 seconds = 0;        // In the operator, including the attempts that changed nothing
+};
+
+using OperatorReport = std::array<OperatorStats, MutationRates::OPERATOR_COUNT>;
+
+// Genealogy of the population. The records of the last RING_GENERATIONS generations are
+// kept in a ring buffer, one slot per individual of each generation, so recording doesn't
+// allocate. The full genealogy can also be written to a CSV file as generations complete.
+class Lineage {
+public:
+    static constexpr i32 RING_GENERATIONS = 64;
+
+    Lineage() noexcept = default;
+
+    Lineage(const Lineage&) = delete;
+    Lineage& operator=(const Lineage&) = delete;
+
+    ~Lineage();
+
+    // Opens the genealogy file, returns false on failure
+    bool open(const char* filename);
+
+    // Records how the index-th child of the next generation was bred
+    void recordChild(i32 index, i32 parent1, i32 parent2, f64 parentFitness, Individual const& child);
+
+    void addCost(i32 op, f64 seconds) noexcept { period[op].seconds += seconds; }
+
+    // Completes the records of the evaluated population, then credits the operators
+    void evaluate(std::vector<Individual> const& individuals, i64 generation);
+
+    // Record of the index-th individual of a generation still in the ring buffer, or nullptr
+    LineageRecord const* find(i64 generation, i32 index) const noexcept;
+
+    // Number of generations the index-th individual of the last evaluated generation was
+    // copied as an elite, within the ring buffer
+    i32 eliteAge(i32 index) const noexcept;
+
+    // Of the best individual of the last evaluated generation
+    i32 getBestIndex() const noexcept { return bestIndex; }
+
+    // Statistics since the last collect
+    OperatorReport collect() noexcept;
+private:
+    LineageRecord& slot(i64 generation, i32 index) noexcept;
+
+    std::vector<LineageRecord> ring;
+    i32 populationSize = 0;
+    i64 lastGeneration = -1;
+    i32 bestIndex = -1;
+    OperatorReport period {};
+    std::FILE* file = nullptr;
+};
+
+extern Lineage lineage;
+
+GA_NAMESPACE_END
+
+#endif // GENALGO_LINEAGE_HPP
@@ -3,6 +3,8 @@
 #include "Color.hpp"
 #include "Vec.hpp"
 #include "GlobalConfig.hpp"
+#include "PoorProfiler.hpp"
+#include "Rasterizer.hpp"
 #include "defer.hpp"
 #include <algorithm>
 #include <cmath>
@@ -11,109 +13,235 @@
 
 GA_NAMESPACE_BEGIN
 
-static bool pointInTriangle(Point<i32> const& p, Point<i32> const& a, Point<i32> const& b, Point<i32> const& c) {
-    auto sign = [](Point<i32> const& p1, Point<i32> const& p2, Point<i32> const& p3) {
-        return (p1.x - p3.x) * (p2.y - p3.y) - (p2.x - p3.x) * (p1.y - p3.y);
-    };
+// Scratch space of the front-to-back compositing, reused by each thread
+static thread_local rasterizer::FrontToBackState frontToBackState;
 
-    bool b1, b2, b3;
+template <typename Metric>
+static void eval(Individual& individual, Vec3d dst[], rasterizer::FrontToBackState& state, Vec3d const src[], f64 const weights[], i32 width, i32 height) {
+    i32 size = width * height;
+
+    if (globalCfg.frontToBack) {
+        // Clears the canvas itself
+        profiler.start(ProfilerZone::cpuRasterize);
+        rasterizer::rasterizeFrontToBack(dst, state, individual, width, height, globalCfg.minTransmittance);
+        profiler.stop(ProfilerZone::cpuRasterize);
+    } else {
+        profiler.start(ProfilerZone::cpuClear);
+        rasterizer::clear(dst, size);
+        profiler.stop(ProfilerZone::cpuClear);
+
+        profiler.start(ProfilerZone::cpuRasterize);
+        rasterizer::rasterize(dst, individual, width, height);
+        profiler.stop(ProfilerZone::cpuRasterize);
+    }
 
-    b1 = sign(p, a, b) < 0;
-    b2 = sign(p, b, c) < 0;
-    b3 = sign(p, c, a) < 0;
+    profiler.start(ProfilerZone::cpuScore);
+    f64 fitness = rasterizer::score<Metric>(dst, src, weights, size);
+    profiler.stop(ProfilerZone::cpuScore);
 
-    return ((b1 == b2) && (b2 == b3));
+    individual.setFitness(fitness);
 }
 
-static Vec3d blend(Vec3d dst, Vec3d src, u8 srcAlpha) {
-    // Equivalent: glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+template <typename Metric>
+static void evalFixed(Individual& individual, fixedpoint::Pixel dst[], fixedpoint::Pixel const src[], f64 const weights[], i32 width, i32 height) {
+    i32 size = width * height;
 
-    f64 alpha = srcAlpha / 255.0;
-    return alpha * src + (1.0 - alpha) * dst;
-}
+    profiler.start(ProfilerZone::cpuClear);
+    fixedpoint::clear(dst, size);
+    profiler.stop(ProfilerZone::cpuClear);
+
+    profiler.start(ProfilerZone::cpuRasterize);
+    fixedpoint::rasterize(dst, individual, width, height);
+    profiler.stop(ProfilerZone::cpuRasterize);
 
-static Vec3d fromColor(Color c) {
-    return Vec3d{1.0 * c.r, 1.0 * c.g, 1.0 * c.b};
+    profiler.start(ProfilerZone::cpuScore);
+    f64 fitness = fixedpoint::score<Metric>(dst, src, weights, size);
+    profiler.stop(ProfilerZone::cpuScore);
+
+    individual.setFitness(fitness);
 }
 
-static void rasterize(Vec3d dst[], Triangle const& t, i32 width, i32 height) {
-    Vec3d color = fromColor(t.color);
-    u8 alpha = t.color.a;
-
-    // Determine the bounding box of the triangle
-    i32 minX = std::max(0, std::min({t.a.x, t.b.x, t.c.x}));
-    i32 minY = std::max(0, std::min({t.a.y, t.b.y, t.c.y}));
-    i32 maxX = std::min(width - 1, std::max({t.a.x, t.b.x, t.c.x}));
-    i32 maxY = std::min(height - 1, std::max({t.a.y, t.b.y, t.c.y}));
-
-    // Iterate over pixels in the bounding box
-    for (i32 y = minY; y <= maxY; ++y) {
-        for (i32 x = minX; x <= maxX; ++x) {
-            // Check if the pixel is inside the triangle
-            if (pointInTriangle({x, y}, t.a, t.b, t.c)) {
-                i32 index = y * width + x;
-                // Blend the triangle color with the destination buffer
-                dst[index] = blend(dst[index], color, alpha);
+template <typename Metric>
+void MTFitnessEngine<Metric>::evaluateBatched(std::vector<Individual>& individuals, Vec3d const src[], f64 const weights[], i32 width, i32 height) {
+    constexpr i32 TILE_PIXELS = BATCH_TILE_SIZE * BATCH_TILE_SIZE;
+    const i32 size = width * height;
+    const i32 count = static_cast<i32>(individuals.size());
+    const i32 tilesX = (width + BATCH_TILE_SIZE - 1) / BATCH_TILE_SIZE;
+    const i32 tiles = tilesX * ((height + BATCH_TILE_SIZE - 1) / BATCH_TILE_SIZE);
+    const i32 groups = (count + BATCH_GROUP_SIZE - 1) / BATCH_GROUP_SIZE;
+    partialErrors.resize(static_cast<std::size_t>(count) * tiles);
+    binTriangles.resize(count);
+    binOffsets.resize(static_cast<std::size_t>(count) * (tiles + 1));
+
+    // Bins the triangles of each individual by the tiles their bounding box overlaps, so
+    // each tile only walks its own triangles
+    #pragma omp parallel for schedule(dynamic)
+    for (i32 i = 0; i < count; i++) {
+        profiler.start(ProfilerZone::cpuRasterize);
+        Individual const& individual = individuals[i];
+        i32* offsets = &binOffsets[static_cast<std::size_t>(i) * (tiles + 1)];
+        std::vector<i32>& bins = binTriangles[i];
+        auto forEachTile = [&](Triangle const& t, auto&& f) {
+            rasterizer::BoundingBox box = rasterizer::boundingBox(t, width, height);
+            if (box.area() == 0)
+                return;
+            for (i32 y = box.minY / BATCH_TILE_SIZE; y <= box.maxY / BATCH_TILE_SIZE; y++) {
+                for (i32 x = box.minX / BATCH_TILE_SIZE; x <= box.maxX / BATCH_TILE_SIZE; x++)
+                    f(y * tilesX + x);
             }
-        }
+        };
+
+        // Counts in offsets[t + 1], then the starts, which the fill moves to the ends
+        std::fill(offsets, offsets + tiles + 1, 0);
+        for (Triangle const& t : individual)
+            forEachTile(t, [&](i32 tile) { offsets[tile + 1]++; });
+        for (i32 tile = 0; tile < tiles; tile++)
+            offsets[tile + 1] += offsets[tile];
+        bins.resize(offsets[tiles]);
+        for (i32 k = 0; k < individual.size(); k++)
+            forEachTile(individual[k], [&](i32 tile) { bins[offsets[tile]++] = k; });
+        for (i32 tile = tiles; tile > 0; tile--)
+            offsets[tile] = offsets[tile - 1];
+        offsets[0] = 0;
+        profiler.stop(ProfilerZone::cpuRasterize);
     }
-}
-
-static void eval(Individual& individual, Vec3d dst[], Vec3d src[], i32 width, i32 height) {
-    i32 size = width * height;
-
-    for (i32 i = 0; i < size; ++i)
-        dst[i] = Vec3d{0, 0, 0};
 
-    for (const Triangle& t : individual) {
-        rasterize(dst, t, width, height);
+    // A work item is a tile of the canvases of a group of individuals. The target tile is
+    // scored against each of them in turn, so it stays in the cache.
+    #pragma omp parallel for schedule(dynamic)
+    for (i32 item = 0; item < tiles * groups; item++) {
+        static thread_local std::vector<Vec3d> scratch(static_cast<std::size_t>(BATCH_GROUP_SIZE) * TILE_PIXELS);
+        const i32 tile = item % tiles;
+        const i32 first = item / tiles * BATCH_GROUP_SIZE;
+        const i32 last = std::min(count, first + BATCH_GROUP_SIZE);
+        const i32 x0 = tile % tilesX * BATCH_TILE_SIZE;
+        const i32 y0 = tile / tilesX * BATCH_TILE_SIZE;
+        const i32 x1 = std::min(width, x0 + BATCH_TILE_SIZE) - 1;
+        const i32 y1 = std::min(height, y0 + BATCH_TILE_SIZE) - 1;
+        const i32 tileWidth = x1 - x0 + 1;
+        const i32 tileHeight = y1 - y0 + 1;
+
+        profiler.start(ProfilerZone::cpuRasterize);
+        for (i32 i = first; i < last; i++) {
+            Vec3d* canvas = &scratch[static_cast<std::size_t>(i - first) * TILE_PIXELS];
+            rasterizer::clear(canvas, tileWidth * tileHeight);
+
+            i32 const* offsets = &binOffsets[static_cast<std::size_t>(i) * (tiles + 1)];
+            Individual const& individual = individuals[i];
+            for (i32 k = offsets[tile]; k < offsets[tile + 1]; k++)
+                rasterizer::rasterize(canvas, individual[binTriangles[i][k]], tileWidth, x0, y0, x0, y0, x1, y1);
+
+            // getCanvas and getResidual read the whole canvases
+            Vec3d* out = dst + static_cast<std::size_t>(i) * size;
+            for (i32 y = 0; y < tileHeight; y++)
+                std::copy(canvas + y * tileWidth, canvas + (y + 1) * tileWidth, out + (y0 + y) * width + x0);
+        }
+        profiler.stop(ProfilerZone::cpuRasterize);
+
+        profiler.start(ProfilerZone::cpuScore);
+        for (i32 i = first; i < last; i++) {
+            Vec3d const* canvas = &scratch[static_cast<std::size_t>(i - first) * TILE_PIXELS];
+            f64 sum = 0;
+            for (i32 y = 0; y < tileHeight; y++) {
+                i32 offset = (y0 + y) * width + x0;
+                sum += rasterizer::errorSum<Metric>(canvas + y * tileWidth, src + offset, weights + offset, tileWidth);
+            }
+            partialErrors[static_cast<std::size_t>(i) * tiles + tile] = sum;
+        }
+        profiler.stop(ProfilerZone::cpuScore);
     }
 
-    f64 fitness = 0.0;
-
-    for (i32 i = 0; i < size; ++i) {
-        Vec3d diff = dst[i] - src[i];
-        Vec3d& pixel = dst[i];
-
-        fitness += norm(diff);
+    // In the order of the tiles, so the fitness doesn't depend on the threads
+    for (i32 i = 0; i < count; i++) {
+        f64 sum = 0;
+        for (i32 tile = 0; tile < tiles; tile++)
+            sum += partialErrors[static_cast<std::size_t>(i) * tiles + tile];
+        individuals[i].setFitness(Metric::finish(sum));
     }
-
-    individual.setFitness(fitness);
 }
 
-void MTFitnessEngine::evaluate_impl(std::vector<Individual>& individuals){
-    if (individuals.size() != globalCfg.populationSize) {
+template <typename Metric>
+void MTFitnessEngine<Metric>::evaluate_impl(std::vector<Individual>& individuals){
+    const i32 count = static_cast<i32>(individuals.size());
+    if (count != globalCfg.populationSize) {
         std::fprintf(stderr, "MTFitnessEngine::evaluate: individuals.size() != populationSize\n");
         std::abort();
     }
     
     i32 width = globalCfg.targetImage.getWidth();
     i32 height = globalCfg.targetImage.getHeight();
+    Vec3d const* src = globalCfg.targetImage.getPremultiplied();
+    f64 const* weights = globalCfg.targetImage.getWeights();
+
+    if (fixedDst) {
+        #pragma omp parallel for
+        for (i32 i = 0; i < count; i++) {
+            evalFixed<Metric>(individuals[i], fixedDst + static_cast<i64>(i) * width * height, fixedTarget.data(), weights, width, height);
+        }
+        return;
+    }
+
+    if (!globalCfg.batchDisabled && !globalCfg.frontToBack && width * height <= BATCH_MAX_PIXELS) {
+        evaluateBatched(individuals, src, weights, width, height);
+        return;
+    }
    
     // Number of threads is controlled by OMP_NUM_THREADS
     #pragma omp parallel for
-    for (i32 i = 0; i < individuals.size(); i++) {
-        eval(individuals[i], dst+(i*width*height), src, width, height);
+    for (i32 i = 0; i < count; i++) {
+        eval<Metric>(individuals[i], dst+(i*width*height), frontToBackState, src, weights, width, height);
     }
 }
 
-MTFitnessEngine::MTFitnessEngine(){
-    i32 width = globalCfg.targetImage.getWidth();
-    i32 height = globalCfg.targetImage.getHeight();
+template <typename Metric>
+bool MTFitnessEngine<Metric>::getCanvas(i32 index, Vec3d dst[]) {
+    i32 size = globalCfg.targetImage.getWidth() * globalCfg.targetImage.getHeight();
+    if (fixedDst) {
+        fixedpoint::fromFixed(dst, fixedDst + static_cast<i64>(index) * size, size);
+        return true;
+    }
+    std::copy(this->dst + static_cast<i64>(index) * size, this->dst + static_cast<i64>(index + 1) * size, dst);
+    return true;
+}
 
-    src = new Vec3d[width * height];  
-    dst = new Vec3d[width * height * globalCfg.populationSize];
+template <typename Metric>
+bool MTFitnessEngine<Metric>::getResidual(i32 index, f64 dst[]) {
+    i32 size = globalCfg.targetImage.getWidth() * globalCfg.targetImage.getHeight();
+    if (fixedDst) {
+        std::vector<Vec3d> canvas(size), target(size);
+        fixedpoint::fromFixed(canvas.data(), fixedDst + static_cast<i64>(index) * size, size);
+        fixedpoint::fromFixed(target.data(), fixedTarget.data(), size);
+        rasterizer::residual<Metric>(dst, canvas.data(), target.data(), globalCfg.targetImage.getWeights(), size);
+        return true;
+    }
+    rasterizer::residual<Metric>(dst, this->dst + static_cast<i64>(index) * size,
+            globalCfg.targetImage.getPremultiplied(), globalCfg.targetImage.getWeights(), size);
+    return true;
+}
 
-    Color* target = reinterpret_cast<Color*>(globalCfg.targetImage.getData());
+template <typename Metric>
+MTFitnessEngine<Metric>::MTFitnessEngine(){
+    i32 width = globalCfg.targetImage.getWidth();
+    i32 height = globalCfg.targetImage.getHeight();
 
-    for (i32 i = 0; i < width * height; ++i) {
-        src[i] = blend({0, 0, 0}, fromColor(target[i]), target[i].a);
+    // Only the canvases of the pipeline in use, the target is converted once
+    if (globalCfg.fixedPoint) {
+        fixedDst = new fixedpoint::Pixel[width * height * globalCfg.populationSize];
+        fixedTarget.resize(width * height);
+        fixedpoint::toFixed(fixedTarget.data(), globalCfg.targetImage.getPremultiplied(), width * height);
+    } else {
+        dst = new Vec3d[width * height * globalCfg.populationSize];
     }
 }
 
-MTFitnessEngine::~MTFitnessEngine(){
-    delete[] src;
+template <typename Metric>
+MTFitnessEngine<Metric>::~MTFitnessEngine(){
     delete[] dst;
+    delete[] fixedDst;
 }
 
+#define GA_MT_INSTANTIATE(M) template class MTFitnessEngine<metric::M>;
+GA_FITNESS_METRICS(GA_MT_INSTANTIATE)
+#undef GA_MT_INSTANTIATE
+
 GA_NAMESPACE_END
\ No newline at end of file
@@ -3,10 +3,14 @@
 
 #include "FitnessEngine.hpp"
 
+#include "FitnessMetric.hpp"
+#include "FixedPoint.hpp"
 #include "Vec.hpp"
+#include <vector>
 
 GA_NAMESPACE_BEGIN
 
+template <typename Metric = metric::L2>
 class MTFitnessEngine final : public FitnessEngine {
 public:
     MTFitnessEngine();
@@ -16,12 +20,47 @@ public:
         return "MTFitnessEngine";
     }
 
+    virtual const char* getMetricName() const noexcept override {
+        return Metric::name;
+    }
+
     void evaluate_impl(std::vector<Individual>& individuals) override;
+    bool getCanvas(i32 index, Vec3d dst[]) override;
+    bool getResidual(i32 index, f64 dst[]) override;
+
+    // Targets of up to BATCH_MAX_PIXELS pixels are evaluated in tiles of BATCH_TILE_SIZE x
+    // BATCH_TILE_SIZE pixels, each for a group of BATCH_GROUP_SIZE individuals, instead of
+    // one individual at a time: the canvases are too small to amortize the loops, and the
+    // target would be read again for every individual. The tiles of a group are drawn in
+    // a scratch canvas of each thread, with only the triangles that overlap them, then
+    // copied to the canvases of the individuals.
+    static constexpr i32 BATCH_MAX_PIXELS = 256 * 256;
+    static constexpr i32 BATCH_TILE_SIZE = 32;
+    static constexpr i32 BATCH_GROUP_SIZE = 8;
 private:
-    Vec3d* src;
-    Vec3d* dst;
+    void evaluateBatched(std::vector<Individual>& individuals, Vec3d const src[], f64 const weights[], i32 width, i32 height);
+
+    Vec3d* dst = nullptr;
+
+    // With globalCfg.fixedPoint, instead of dst, and the target converted once
+    fixedpoint::Pixel* fixedDst = nullptr;
+    std::vector<fixedpoint::Pixel> fixedTarget;
+
+    // Error sums of each tile of each individual, of evaluateBatched
+    std::vector<f64> partialErrors;
+
+    // Triangles overlapping each tile of each individual in order, of evaluateBatched: the
+    // ones of the tile t of the individual i are binTriangles[i][binOffsets[i * (tiles + 1)
+    // + t]] up to the next offset
+    std::vector<std::vector<i32>> binTriangles;
+    std::vector<i32> binOffsets;
 };
 
+// Instantiated in MTFitnessEngine.cpp
+#define GA_MT_EXTERN(M) extern template class MTFitnessEngine<metric::M>;
+GA_FITNESS_METRICS(GA_MT_EXTERN)
+#undef GA_MT_EXTERN
+
 GA_NAMESPACE_END
 
-#endif // GENALGO_STFITNESSENGINE_HPP
+#endif // GENALGO_MTFITNESSENGINE_HPP
@@ -0,0 +1,302 @@
+#include "Metrics.hpp"
+
+#include "JSONSerializer.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <limits>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+GA_NAMESPACE_BEGIN
+
+// FNV-1a of the triangles, only used to count distinct genomes
+static u64 hashGenome(Individual const& individual) {
+    u64 hash = 0xcbf29ce484222325ull;
+    auto add = [&](u32 value) {
+        for (i32 i = 0; i < 4; ++i) {
+            hash ^= (value >> (8 * i)) & 0xff;
+            hash *= 0x100000001b3ull;
+        }
+    };
+
+    for (Triangle const& t : individual) {
+        add(t.a.x); add(t.a.y);
+        add(t.b.x); add(t.b.y);
+        add(t.c.x); add(t.c.y);
+        add(t.color.toRGBA());
+    }
+    return hash;
+}
+
+PopulationStats PopulationStats::compute(Population const& population) {
+    std::vector<Individual> const& individuals = population.getIndividuals();
+    PopulationStats stats;
+    if (individuals.empty())
+        return stats;
+
+    std::vector<f64> fitness;
+    fitness.reserve(individuals.size());
+    std::unordered_set<u64> genomes;
+    genomes.reserve(individuals.size());
+
+    stats.minTriangles = std::numeric_limits<i32>::max();
+    i64 totalTriangles = 0;
+    for (Individual const& i : individuals) {
+        fitness.push_back(i.getFitness());
+        genomes.insert(hashGenome(i));
+
+        stats.minTriangles = std::min(stats.minTriangles, i.size());
+        stats.maxTriangles = std::max(stats.maxTriangles, i.size());
+        totalTriangles += i.size();
+    }
+
+    auto median = fitness.begin() + fitness.size() / 2;
+    std::nth_element(fitness.begin(), median, fitness.end());
+    stats.medianFitness = *median;
+    stats.bestFitness = *std::min_element(fitness.begin(), fitness.end());
+    stats.worstFitness = *std::max_element(fitness.begin(), fitness.end());
+
+    stats.meanTriangles = static_cast<f64>(totalTriangles) / individuals.size();
+    stats.diversity = static_cast<f64>(genomes.size()) / individuals.size();
+    return stats;
+}
+
+static bool hasCSVExtension(const char* filename) {
+    std::string_view name(filename);
+    std::string_view ext = ".csv";
+    if (name.size() < ext.size())
+        return false;
+
+    return std::equal(ext.begin(), ext.end(), name.end() - ext.size(), [](char a, char b) {
+        return a == std::tolower(static_cast<unsigned char>(b));
+    });
+}
+
+bool MetricsWriter::open(const char* metricsFilename, const char* prometheusFilename) {
+    if (prometheusFilename)
+        this->prometheusFilename = prometheusFilename;
+
+    if (!metricsFilename)
+        return true;
+
+    stream.open(metricsFilename, std::ios::trunc);
+    if (!stream)
+        return false;
+
+    csv = hasCSVExtension(metricsFilename);
+    if (csv) {
+        // The columns don't depend on the zones used by the engine, so runs can be compared
+        stream << "generation,elapsed,generations_per_second,best_fitness,median_fitness,worst_fitness,"
+                  "min_triangles,mean_triangles,max_triangles,diversity";
+        for (i32 z = 0; z < PROFILER_ZONE_COUNT; ++z) {
+            const char* key = profilerZoneKey(static_cast<ProfilerZone>(z));
+            stream << ',' << key << "_ms," << key << "_p99_ms";
+        }
+        for (i32 op = 0; op < MutationRates::OPERATOR_COUNT; ++op) {
+            const char* name = MutationRates::operatorName(op);
+            stream << ',' << name << "_children," << name << "_improved," << name << "_mean_delta," << name << "_us";
+        }
+        stream << '\n';
+    }
+    return static_cast<bool>(stream);
+}
+
+bool MetricsWriter::write(MetricsRecord const& record) {
+    if (stream.is_open()) {
+        if (csv) {
+            writeCSV(record);
+        } else {
+            writeJSON(record);
+        }
+        stream.flush();
+    }
+
+    bool ok = !stream.is_open() || static_cast<bool>(stream);
+    if (!prometheusFilename.empty())
+        ok = writePrometheus(record) && ok;
+    return ok;
+}
+
+void MetricsWriter::writeJSON(MetricsRecord const& record) {
+    PopulationStats const& pop = record.population;
+    f64 generations = record.generations;
+
+    json::serialize(stream, [&](JSONSerializerState& state) {
+        JSONObjectBuilder object = state.serialize_object();
+        object
+            .add("generation", record.generation)
+            .add("elapsed", record.elapsed)
+            .add("generations_per_second", record.generationsPerSecond)
+            .add("fitness", [&](JSONSerializerState& state) {
+                state.serialize_object()
+                    .add("best", pop.bestFitness)
+                    .add("median", pop.medianFitness)
+                    .add("worst", pop.worstFitness);
+            })
+            .add("triangles", [&](JSONSerializerState& state) {
+                state.serialize_object()
+                    .add("min", pop.minTriangles)
+                    .add("mean", pop.meanTriangles)
+                    .add("max", pop.maxTriangles);
+            })
+            .add("diversity", pop.diversity)
+            .add("zones", [&](JSONSerializerState& state) {
+                // Times in milliseconds, the mean is per generation
+                JSONObjectBuilder zones = state.serialize_object();
+                for (i32 z = 0; z < PROFILER_ZONE_COUNT; ++z) {
+                    ProfilerZone zone = static_cast<ProfilerZone>(z);
+                    ProfilerZoneStats const& stats = record.report[zone];
+                    if (stats.count == 0)
+                        continue;
+
+                    zones.add(profilerZoneKey(zone), [&](JSONSerializerState& state) {
+                        state.serialize_object()
+                            .add("count", stats.count)
+                            .add("mean_ms", 1000 * stats.elapsed / generations)
+                            .add("p50_ms", 1000 * stats.p50)
+                            .add("p99_ms", 1000 * stats.p99)
+                            .add("max_ms", 1000 * stats.max);
+                    });
+                }
+            });
+
+        if (record.operators) {
+            object.add("operators", [&](JSONSerializerState& state) {
+                // Per generation, except the fraction improved and the mean delta, per child
+                JSONObjectBuilder operators = state.serialize_object();
+                for (i32 op = 0; op < MutationRates::OPERATOR_COUNT; ++op) {
+                    OperatorStats const& stats = (*record.operators)[op];
+                    f64 applications = std::max<i64>(stats.applications, 1);
+                    operators.add(MutationRates::operatorName(op), [&](JSONSerializerState& state) {
+                        state.serialize_object()
+                            .add("children", stats.applications / generations)
+                            .add("improved", stats.improvements / applications)
+                            .add("mean_delta", stats.fitnessDelta / applications)
+                            .add("us", 1e6 * stats.seconds / generations);
+                    });
+                }
+            });
+        }
+    });
+    stream << '\n';
+}
+
+void MetricsWriter::writeCSV(MetricsRecord const& record) {
+    PopulationStats const& pop = record.population;
+    f64 generations = record.generations;
+
+    char buffer[512];
+    std::snprintf(buffer, sizeof(buffer), "%lld,%.3f,%.3f,%.17g,%.17g,%.17g,%d,%.3f,%d,%.6f",
+            static_cast<long long>(record.generation), record.elapsed, record.generationsPerSecond,
+            pop.bestFitness, pop.medianFitness, pop.worstFitness,
+            pop.minTriangles, pop.meanTriangles, pop.maxTriangles, pop.diversity);
+    stream << buffer;
+
+    // Zones that didn't run in the period have empty cells
+    for (i32 z = 0; z < PROFILER_ZONE_COUNT; ++z) {
+        ProfilerZoneStats const& stats = record.report[static_cast<ProfilerZone>(z)];
+        if (stats.count == 0) {
+            stream << ",,";
+            continue;
+        }
+
+        std::snprintf(buffer, sizeof(buffer), ",%.6f,%.6f", 1000 * stats.elapsed / generations, 1000 * stats.p99);
+        stream << buffer;
+    }
+
+    // Empty cells if the lineage isn't recorded
+    for (i32 op = 0; op < MutationRates::OPERATOR_COUNT; ++op) {
+        if (!record.operators) {
+            stream << ",,,,";
+            continue;
+        }
+
+        OperatorStats const& stats = (*record.operators)[op];
+        f64 applications = std::max<i64>(stats.applications, 1);
+        std::snprintf(buffer, sizeof(buffer), ",%.3f,%.6f,%.17g,%.3f", stats.applications / generations,
+                stats.improvements / applications, stats.fitnessDelta / applications, 1e6 * stats.seconds / generations);
+        stream << buffer;
+    }
+    stream << '\n';
+}
+
+bool MetricsWriter::writePrometheus(MetricsRecord const& record) const {
+    // The collector may read the file at any time: write a temporary file and rename it,
+    // which is atomic as long as both are in the same filesystem.
+    std::string tmpFilename = prometheusFilename + ".tmp";
+    std::FILE* file = std::fopen(tmpFilename.c_str(), "w");
+    if (!file)
+        return false;
+
+    PopulationStats const& pop = record.population;
+    auto gauge = [&](const char* name, const char* help) {
+        std::fprintf(file, "# HELP genalgo_%s %s\n# TYPE genalgo_%s gauge\n", name, help, name);
+    };
+
+    gauge("generation", "Current generation");
+    std::fprintf(file, "genalgo_generation %lld\n", static_cast<long long>(record.generation));
+    gauge("elapsed_seconds", "Seconds since the start of the run");
+    std::fprintf(file, "genalgo_elapsed_seconds %.3f\n", record.elapsed);
+    gauge("generations_per_second", "Generations per second during the last log period");
+    std::fprintf(file, "genalgo_generations_per_second %.3f\n", record.generationsPerSecond);
+
+    gauge("fitness", "Unweighted fitness of the population (lower is better)");
+    std::fprintf(file, "genalgo_fitness{stat=\"best\"} %.17g\n", pop.bestFitness);
+    std::fprintf(file, "genalgo_fitness{stat=\"median\"} %.17g\n", pop.medianFitness);
+    std::fprintf(file, "genalgo_fitness{stat=\"worst\"} %.17g\n", pop.worstFitness);
+
+    gauge("triangles", "Number of triangles of the individuals");
+    std::fprintf(file, "genalgo_triangles{stat=\"min\"} %d\n", pop.minTriangles);
+    std::fprintf(file, "genalgo_triangles{stat=\"mean\"} %.3f\n", pop.meanTriangles);
+    std::fprintf(file, "genalgo_triangles{stat=\"max\"} %d\n", pop.maxTriangles);
+
+    gauge("diversity", "Fraction of individuals with a distinct genome");
+    std::fprintf(file, "genalgo_diversity %.6f\n", pop.diversity);
+
+    gauge("zone_seconds", "Time spent in the profiler zone per generation during the last log period");
+    for (i32 z = 0; z < PROFILER_ZONE_COUNT; ++z) {
+        ProfilerZone zone = static_cast<ProfilerZone>(z);
+        std::fprintf(file, "genalgo_zone_seconds{zone=\"%s\"} %.9f\n",
+                profilerZoneKey(zone), record.report[zone].elapsed / record.generations);
+    }
+
+    gauge("zone_p99_seconds", "99th percentile of the duration of the profiler zone during the last log period");
+    for (i32 z = 0; z < PROFILER_ZONE_COUNT; ++z) {
+        ProfilerZone zone = static_cast<ProfilerZone>(z);
+        std::fprintf(file, "genalgo_zone_p99_seconds{zone=\"%s\"} %.9f\n",
+                profilerZoneKey(zone), record.report[zone].p99);
+    }
+
+    if (record.operators) {
+        gauge("operator_children", "Children mutated by the operator per generation during the last log period");
+        for (i32 op = 0; op < MutationRates::OPERATOR_COUNT; ++op) {
+            std::fprintf(file, "genalgo_operator_children{operator=\"%s\"} %.3f\n",
+                    MutationRates::operatorName(op), (*record.operators)[op].applications / static_cast<f64>(record.generations));
+        }
+
+        gauge("operator_improved", "Fraction of the children of the operator better than their best parent");
+        for (i32 op = 0; op < MutationRates::OPERATOR_COUNT; ++op) {
+            OperatorStats const& stats = (*record.operators)[op];
+            std::fprintf(file, "genalgo_operator_improved{operator=\"%s\"} %.6f\n",
+                    MutationRates::operatorName(op), stats.improvements / static_cast<f64>(std::max<i64>(stats.applications, 1)));
+        }
+
+        gauge("operator_seconds", "Time spent in the operator per generation during the last log period");
+        for (i32 op = 0; op < MutationRates::OPERATOR_COUNT; ++op) {
+            std::fprintf(file, "genalgo_operator_seconds{operator=\"%s\"} %.9f\n",
+                    MutationRates::operatorName(op), (*record.operators)[op].seconds / record.generations);
+        }
+    }
+
+    bool ok = !std::ferror(file);
+    ok = std::fclose(file) == 0 && ok;
+    if (!ok || std::rename(tmpFilename.c_str(), prometheusFilename.c_str()) != 0) {
+        std::remove(tmpFilename.c_str());
+        return false;
+    }
+    return true;
+}
+
+GA_NAMESPACE_END
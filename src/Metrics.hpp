@@ -0,0 +1,70 @@
+#ifndef GENALGO_METRICS_HPP
+#define GENALGO_METRICS_HPP
+
+#include "base.hpp"
+#include "Lineage.hpp"
+#include "Population.hpp"
+#include "PoorProfiler.hpp"
+#include <fstream>
+#include <string>
+
+GA_NAMESPACE_BEGIN
+
+// Statistics of an evaluated population. Fitness is the unweighted fitness.
+struct PopulationStats {
+    f64 bestFitness = 0;
+    f64 medianFitness = 0;
+    f64 worstFitness = 0;
+
+    i32 minTriangles = 0;
+    i32 maxTriangles = 0;
+    f64 meanTriangles = 0;
+
+    // Fraction of individuals with a distinct genome, in (0, 1]
+    f64 diversity = 0;
+
+    static PopulationStats compute(Population const& population);
+};
+
+// One record per log period
+struct MetricsRecord {
+    i64 generation;
+    u32 generations;        // Generations in the period
+    f64 elapsed;            // Seconds since the start of the run
+    f64 generationsPerSecond;
+    PopulationStats population;
+    ProfilerReport const& report;
+    OperatorReport const* operators = nullptr;  // If the lineage is recorded
+};
+
+// Machine-readable counterpart of the periodic log.
+//   * Metrics file: one record per line, JSON Lines or CSV (chosen by the .csv extension)
+//   * Prometheus file: the latest record in the text exposition format, for the
+//     node_exporter textfile collector. The file is replaced atomically.
+class MetricsWriter {
+public:
+    MetricsWriter() noexcept = default;
+
+    MetricsWriter(const MetricsWriter&) = delete;
+    MetricsWriter& operator=(const MetricsWriter&) = delete;
+
+    // Any of the filenames may be null
+    bool open(const char* metricsFilename, const char* prometheusFilename);
+
+    bool isOpen() const { return stream.is_open() || !prometheusFilename.empty(); }
+
+    bool write(MetricsRecord const& record);
+
+private:
+    void writeJSON(MetricsRecord const& record);
+    void writeCSV(MetricsRecord const& record);
+    bool writePrometheus(MetricsRecord const& record) const;
+
+    std::ofstream stream;
+    bool csv = false;
+    std::string prometheusFilename;
+};
+
+GA_NAMESPACE_END
+
+#endif // GENALGO_METRICS_HPP
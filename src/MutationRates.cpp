@@ -0,0 +1,93 @@
+#include "MutationRates.hpp"
+
+#include "GlobalConfig.hpp"
+#include <algorithm>
+
+GA_NAMESPACE_BEGIN
+
+MutationRates mutationRates;
+
+static std::array<f64*, MutationRates::OPERATOR_COUNT> chances() {
+    return {
+        &globalCfg.mutationChanceAdd,
+        &globalCfg.mutationChanceRemove,
+        &globalCfg.mutationChanceReplace,
+        &globalCfg.mutationChanceSwap,
+        &globalCfg.mutationChanceMerge,
+        &globalCfg.mutationChanceSplit,
+        &globalCfg.mutationChanceShape
+    };
+}
+
+const char* MutationRates::operatorName(i32 op) noexcept {
+    static const char* names[OPERATOR_COUNT] = {
+        "add", "remove", "replace", "swap", "merge", "split", "shape"
+    };
+    return op >= 0 && op < OPERATOR_COUNT ? names[op] : "unknown";
+}
+
+f64 MutationRates::getChance(i32 op) noexcept {
+    return *chances()[op];
+}
+
+void MutationRates::update(std::vector<Individual> const& individuals) {
+    const i32 size = static_cast<i32>(individuals.size());
+    const i32 poolSize = std::min(globalCfg.breedPoolSize, size);
+    if (poolSize <= 0)
+        return;
+
+    auto chance = chances();
+    if (!initialized) {
+        // Until they are measured, the operators are as good as a random child
+        total = 0;
+        for (i32 op = 0; op < OPERATOR_COUNT; ++op) {
+            enabled[op] = *chance[op] > 0;
+            total += *chance[op];
+            successRates[op] = static_cast<f64>(poolSize) / size;
+        }
+        initialized = true;
+    }
+
+    // Same ranking as Population::breed, ties with the last one of the pool count as in it
+    fitnesses.resize(size);
+    for (i32 i = 0; i < size; ++i)
+        fitnesses[i] = individuals[i].getWeightedFitness();
+    std::nth_element(fitnesses.begin(), fitnesses.begin() + (poolSize - 1), fitnesses.end());
+    const f64 threshold = fitnesses[poolSize - 1];
+
+    std::array<i32, OPERATOR_COUNT> trials {};
+    std::array<i32, OPERATOR_COUNT> successes {};
+    for (Individual const& individual : individuals) {
+        u32 applied = individual.getAppliedMutations();
+        bool success = individual.getWeightedFitness() <= threshold;
+        for (i32 op = 0; op < OPERATOR_COUNT; ++op) {
+            if (applied & (1u << op)) {
+                ++trials[op];
+                successes[op] += success;
+            }
+        }
+    }
+
+    f64 sum = 0;
+    i32 count = 0;
+    for (i32 op = 0; op < OPERATOR_COUNT; ++op) {
+        if (!enabled[op])
+            continue;
+        if (trials[op] > 0)
+            successRates[op] += DECAY * (static_cast<f64>(successes[op]) / trials[op] - successRates[op]);
+        sum += successRates[op];
+        ++count;
+    }
+    if (count == 0)
+        return;
+
+    for (i32 op = 0; op < OPERATOR_COUNT; ++op) {
+        f64 share = 0;
+        if (enabled[op])
+            share = sum > 0 ? MIN_SHARE + (1 - count * MIN_SHARE) * successRates[op] / sum : 1.0 / count;
+        *chance[op] = total * share;
+    }
+    globalCfg.buildMutationTables();
+}
+
+GA_NAMESPACE_END
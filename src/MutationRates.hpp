@@ -0,0 +1,49 @@
+#ifndef GENALGO_MUTATIONRATES_HPP
+#define GENALGO_MUTATIONRATES_HPP
+
+#include "base.hpp"
+#include "Individual.hpp"
+#include <array>
+#include <vector>
+
+GA_NAMESPACE_BEGIN
+
+// Self-adaptive probabilities of the operators of Individual::mutate, as a bandit with
+// probability matching. The success rate of an operator is the fraction of the children it
+// mutated that enter the breeding pool, averaged over the generations with an exponential
+// decay. Each operator then gets a share of the configured total probability of mutation
+// proportional to its success rate, but at least MIN_SHARE of it. Operators configured
+// with a probability of 0 stay disabled.
+class MutationRates {
+public:
+    // Same order as GlobalConfig::buildMutationTables
+    static constexpr i32 OPERATOR_COUNT = 7;
+
+    // Weight of the last generation in the success rates
+    static constexpr f64 DECAY = 0.1;
+    // Minimum share of each enabled operator in the total probability of mutation
+    static constexpr f64 MIN_SHARE = 0.02;
+
+    // Credits the operators of the evaluated individuals, then updates the probabilities
+    // of globalCfg and its mutation tables
+    void update(std::vector<Individual> const& individuals);
+
+    f64 getSuccessRate(i32 op) const noexcept { return successRates[op]; }
+    static const char* operatorName(i32 op) noexcept;
+    // Current probability of the operator in globalCfg
+    static f64 getChance(i32 op) noexcept;
+private:
+    bool initialized = false;
+    f64 total = 0;
+    std::array<bool, OPERATOR_COUNT> enabled {};
+    std::array<f64, OPERATOR_COUNT> successRates {};
+
+    // Scratch space, to find the fitness of the last individual of the breeding pool
+    std::vector<f64> fitnesses;
+};
+
+extern MutationRates mutationRates;
+
+GA_NAMESPACE_END
+
+#endif // GENALGO_MUTATIONRATES_HPP
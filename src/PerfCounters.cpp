@@ -0,0 +1,89 @@
+#include "PerfCounters.hpp"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+#endif
+
+GA_NAMESPACE_BEGIN
+
+#ifdef __linux__
+
+static i32 openCounter(u64 config, i32 groupFd) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.read_format = PERF_FORMAT_GROUP;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    // pid = 0, cpu = -1: Calling thread, on any CPU
+    return static_cast<i32>(syscall(SYS_perf_event_open, &attr, 0, -1, groupFd, 0));
+}
+
+PerfCounters::PerfCounters() {
+    static constexpr u64 configs[PERF_COUNTER_COUNT] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES
+    };
+
+    for (i32 i = 0; i < PERF_COUNTER_COUNT; ++i) {
+        fds[i] = openCounter(configs[i], leader);
+        groupIndex[i] = -1;
+        if (fds[i] < 0)
+            continue;
+
+        if (leader < 0)
+            leader = fds[i];
+        groupIndex[i] = groupSize++;
+        mask |= 1u << i;
+    }
+}
+
+PerfCounters::~PerfCounters() {
+    // Members must be closed before the leader
+    for (i32 i = PERF_COUNTER_COUNT - 1; i >= 0; --i) {
+        if (fds[i] >= 0)
+            close(fds[i]);
+    }
+}
+
+bool PerfCounters::read(u64 values[PERF_COUNTER_COUNT]) const {
+    if (groupSize == 0)
+        return false;
+
+    // PERF_FORMAT_GROUP: { u64 nr; u64 values[nr]; }
+    u64 buffer[1 + PERF_COUNTER_COUNT];
+    ssize_t expected = (1 + groupSize) * sizeof(u64);
+    if (::read(leader, buffer, sizeof(buffer)) != expected)
+        return false;
+
+    for (i32 i = 0; i < PERF_COUNTER_COUNT; ++i)
+        values[i] = groupIndex[i] >= 0 ? buffer[1 + groupIndex[i]] : 0;
+    return true;
+}
+
+#else
+
+PerfCounters::PerfCounters() {
+    for (i32 i = 0; i < PERF_COUNTER_COUNT; ++i) {
+        fds[i] = -1;
+        groupIndex[i] = -1;
+    }
+}
+
+PerfCounters::~PerfCounters() = default;
+
+bool PerfCounters::read(u64[PERF_COUNTER_COUNT]) const {
+    return false;
+}
+
+#endif
+
+GA_NAMESPACE_END
@@ -0,0 +1,48 @@
+#ifndef GENALGO_PERFCOUNTERS_HPP
+#define GENALGO_PERFCOUNTERS_HPP
+
+#include "base.hpp"
+
+GA_NAMESPACE_BEGIN
+
+enum class PerfCounter : u8 {
+    cycles,
+    instructions,
+    llcMisses,
+    branchMisses,
+    count
+};
+
+constexpr i32 PERF_COUNTER_COUNT = static_cast<i32>(PerfCounter::count);
+
+// Hardware performance counters of the calling thread (perf_event_open on Linux).
+// Counters that can't be opened (e.g. in containers or virtual machines) are
+// reported as unavailable and always read as 0.
+class PerfCounters {
+public:
+    PerfCounters();
+    ~PerfCounters();
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    // Bit i is set if the counter i is available
+    u32 availableMask() const noexcept { return mask; }
+
+    // Current values, counted since construction. Must be called by the thread that
+    // constructed the object. Returns false if the counters couldn't be read.
+    bool read(u64 values[PERF_COUNTER_COUNT]) const;
+
+private:
+    i32 fds[PERF_COUNTER_COUNT];
+    i32 leader = -1;
+
+    // Position of each counter in the group read
+    i32 groupIndex[PERF_COUNTER_COUNT];
+    i32 groupSize = 0;
+    u32 mask = 0;
+};
+
+GA_NAMESPACE_END
+
+#endif // GENALGO_PERFCOUNTERS_HPP
@@ -1,28 +1,251 @@
 #include "PoorProfiler.hpp"
+#include <algorithm>
+#include <bit>
+#include <cinttypes>
+#include <cstdio>
 #include <stdexcept>
+#include <string>
 
 GA_NAMESPACE_BEGIN
 
 PoorProfiler profiler;
 
-void PoorProfiler::throw_bad_stopwatch() {
-    throw std::runtime_error("Stopwatch: No such name");
+void ProfilerThread::throw_too_deep() {
+    throw std::runtime_error("Profiler: Too many nested zones");
 }
 
-void PoorProfiler::throw_bad_pop(const char* name) {
-    throw std::runtime_error("Stopwatch: Out of order pop for " + std::string(name));
+void ProfilerThread::throw_bad_pop(ProfilerZone zone) {
+    throw std::runtime_error("Profiler: Out of order pop for " +
+            std::string(profiler_detail::zoneInfo[static_cast<i32>(zone)].name));
 }
 
-ProfilerStopwatch& PoorProfiler::newStopwatch(const char* name, const char* display) {
-    // Prevent iterator invalidation
-    if (stopwatches.size() == stopwatches.capacity())
-        throw std::runtime_error("Stopwatch: Too many stopwatches");
+i32 ProfilerThread::histogramBucket(u64 ns) {
+    constexpr u64 SUB = 1 << HISTOGRAM_SUB_BITS;
+    if (ns < SUB)
+        return static_cast<i32>(ns);
 
-    ProfilerStopwatch sw(display, activeStopwatches.empty() ? nullptr : activeStopwatches.back());
-    stopwatches.push_back(sw);
-    ProfilerStopwatch* ptr = &stopwatches.back();
-    stopwatchesMap[name] = ptr;
-    return *ptr;
+    i32 msb = std::bit_width(ns) - 1;
+    i32 sub = (ns >> (msb - HISTOGRAM_SUB_BITS)) & (SUB - 1);
+    return (msb - HISTOGRAM_SUB_BITS + 1) * SUB + sub;
+}
+
+u64 ProfilerThread::histogramBucketValue(i32 bucket) {
+    constexpr i32 SUB = 1 << HISTOGRAM_SUB_BITS;
+    if (bucket < SUB)
+        return bucket;
+
+    i32 shift = bucket / SUB - 1;
+    u64 lower = static_cast<u64>(SUB + bucket % SUB) << shift;
+    u64 width = u64(1) << shift;
+    return lower + width / 2;
+}
+
+bool ProfilerThread::readPerf(u64 values[PERF_COUNTER_COUNT]) {
+    if (!perfOpened) {
+        perfOpened = true;
+        perfCounters = std::make_unique<PerfCounters>();
+        perfMask.store(perfCounters->availableMask(), std::memory_order_relaxed);
+    }
+
+    return perfCounters->read(values);
+}
+
+void ProfilerThread::record(ActiveZone const& active, u64 endNs, bool trace) {
+    ProfilerZone zone = active.zone;
+    u64 startNs = active.startNs;
+    ZoneCounters& counters = zones[static_cast<i32>(zone)];
+    u64 elapsed = endNs - startNs;
+
+    // There is a single writer, so a load followed by a store is enough.
+    // The atomics are only needed for the readers.
+    auto increment = [](std::atomic<u64>& value, u64 amount) {
+        value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    };
+
+    increment(counters.count, 1);
+    increment(counters.totalNs, elapsed);
+    increment(counters.histogram[histogramBucket(elapsed)], 1);
+
+    u64 perfValues[PERF_COUNTER_COUNT];
+    if (active.perf && perfCounters->read(perfValues)) {
+        for (i32 i = 0; i < PERF_COUNTER_COUNT; ++i)
+            increment(counters.perf[i], perfValues[i] - active.perfValues[i]);
+    }
+
+    // The maximum is reset by the reader
+    u64 max = counters.maxNs.load(std::memory_order_relaxed);
+    while (elapsed > max && !counters.maxNs.compare_exchange_weak(max, elapsed, std::memory_order_relaxed)) {}
+
+    if (!trace)
+        return;
+
+    if (!events)
+        events = std::make_unique<TraceEvent[]>(TRACE_CAPACITY);
+
+    u64 head = eventsHead.load(std::memory_order_relaxed);
+    if (head - eventsTail.load(std::memory_order_acquire) >= TRACE_CAPACITY) {
+        increment(eventsDropped, 1);
+        return;
+    }
+
+    events[head & (TRACE_CAPACITY - 1)] = TraceEvent{startNs, endNs, zone};
+    eventsHead.store(head + 1, std::memory_order_release);
+}
+
+PoorProfiler::PoorProfiler()
+    : perfEnabled(false),
+      tracing(false)
+{
+    for (i32 i = 0; i < PROFILER_ZONE_COUNT; ++i)
+        displayNames[i] = profiler_detail::zoneInfo[i].name;
+}
+
+PoorProfiler::~PoorProfiler() = default;
+
+ProfilerThread& PoorProfiler::registerThread() {
+    // Value-initialization zeroes all the counters
+    auto thread = std::unique_ptr<ProfilerThread>(new ProfilerThread());
+
+    std::lock_guard lock(threadsMutex);
+    thread->id = threads.size();
+    threads.push_back(std::move(thread));
+    return *threads.back();
+}
+
+ProfilerReport PoorProfiler::collect() {
+    constexpr i32 BUCKETS = ProfilerThread::HISTOGRAM_BUCKETS;
+
+    ProfilerReport report;
+    std::vector<u64> histograms(PROFILER_ZONE_COUNT * BUCKETS, 0);
+    std::array<u64, PROFILER_ZONE_COUNT> maxNs {};
+    std::array<u64, PROFILER_ZONE_COUNT> totalNs {};
+    u32 perfMask = 0;
+
+    std::lock_guard lock(threadsMutex);
+    while (snapshots.size() < threads.size())
+        snapshots.push_back(std::make_unique<std::array<ZoneSnapshot, PROFILER_ZONE_COUNT>>());
+
+    for (std::size_t t = 0; t < threads.size(); ++t) {
+        perfMask |= threads[t]->perfMask.load(std::memory_order_relaxed);
+        for (i32 z = 0; z < PROFILER_ZONE_COUNT; ++z) {
+            ProfilerThread::ZoneCounters& counters = threads[t]->zones[z];
+            ZoneSnapshot& snapshot = (*snapshots[t])[z];
+
+            u64 count = counters.count.load(std::memory_order_relaxed);
+            if (count == snapshot.count)
+                continue;
+
+            u64 total = counters.totalNs.load(std::memory_order_relaxed);
+            report.zones[z].count += count - snapshot.count;
+            totalNs[z] += total - snapshot.totalNs;
+            snapshot.count = count;
+            snapshot.totalNs = total;
+
+            u64* histogram = &histograms[z * BUCKETS];
+            for (i32 b = 0; b < BUCKETS; ++b) {
+                u64 value = counters.histogram[b].load(std::memory_order_relaxed);
+                histogram[b] += value - snapshot.histogram[b];
+                snapshot.histogram[b] = value;
+            }
+
+            for (i32 i = 0; i < PERF_COUNTER_COUNT; ++i) {
+                u64 value = counters.perf[i].load(std::memory_order_relaxed);
+                report.zones[z].perf[i] += value - snapshot.perf[i];
+                snapshot.perf[i] = value;
+            }
+
+            maxNs[z] = std::max(maxNs[z], counters.maxNs.exchange(0, std::memory_order_relaxed));
+        }
+    }
+
+    for (i32 z = 0; z < PROFILER_ZONE_COUNT; ++z) {
+        ProfilerZoneStats& stats = report.zones[z];
+        if (stats.count == 0)
+            continue;
+
+        u64* histogram = &histograms[z * BUCKETS];
+        auto percentile = [&](f64 q) {
+            u64 target = std::max<u64>(1, static_cast<u64>(q * stats.count + 0.5));
+            u64 accumulated = 0;
+            for (i32 b = 0; b < BUCKETS; ++b) {
+                accumulated += histogram[b];
+                if (accumulated >= target)
+                    return std::min(ProfilerThread::histogramBucketValue(b), maxNs[z]);
+            }
+            return maxNs[z];
+        };
+
+        stats.elapsed = 1e-9 * totalNs[z];
+        stats.p50 = 1e-9 * percentile(0.50);
+        stats.p99 = 1e-9 * percentile(0.99);
+        stats.max = 1e-9 * maxNs[z];
+        stats.perfMask = perfMask;
+    }
+
+    return report;
+}
+
+bool PoorProfiler::startTrace(const char* filename) {
+    traceStream.open(filename, std::ios::trunc);
+    if (!traceStream)
+        return false;
+
+    // JSON Array Format: the closing bracket is optional, so the trace
+    // is still readable if the process doesn't exit cleanly.
+    traceStream << "[\n";
+    traceSeparator = false;
+    traceEpochNs = profilerNowNs();
+    tracing.store(true, std::memory_order_relaxed);
+    return true;
+}
+
+void PoorProfiler::flushTrace() {
+    if (!traceStream.is_open())
+        return;
+
+    char buffer[256];
+    auto writeEvent = [&](ProfilerThread const& thread, ProfilerThread::TraceEvent const& event) {
+        f64 ts = 1e-3 * static_cast<i64>(event.startNs - traceEpochNs);
+        f64 dur = 1e-3 * (event.endNs - event.startNs);
+        std::snprintf(buffer, sizeof(buffer),
+                "%s{\"name\":\"%s\",\"cat\":\"genalgo\",\"ph\":\"X\",\"pid\":1,\"tid\":%" PRIu32 ",\"ts\":%.3f,\"dur\":%.3f}",
+                traceSeparator ? ",\n" : "", getDisplayName(event.zone), thread.id, ts, dur);
+        traceStream << buffer;
+        traceSeparator = true;
+    };
+
+    std::lock_guard lock(threadsMutex);
+    for (auto& thread : threads) {
+        u64 head = thread->eventsHead.load(std::memory_order_acquire);
+        u64 tail = thread->eventsTail.load(std::memory_order_relaxed);
+        for (u64 i = tail; i < head; ++i)
+            writeEvent(*thread, thread->events[i & (ProfilerThread::TRACE_CAPACITY - 1)]);
+        thread->eventsTail.store(head, std::memory_order_release);
+    }
+    traceStream.flush();
+}
+
+void PoorProfiler::stopTrace() {
+    if (!traceStream.is_open())
+        return;
+
+    tracing.store(false, std::memory_order_relaxed);
+    flushTrace();
+
+    std::lock_guard lock(threadsMutex);
+    for (auto& thread : threads) {
+        std::string name = thread->name ? thread->name : "thread " + std::to_string(thread->id);
+        traceStream << (traceSeparator ? ",\n" : "")
+                    << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread->id
+                    << ",\"args\":{\"name\":\"" << name << "\"}}";
+        traceSeparator = true;
+
+        u64 dropped = thread->eventsDropped.load(std::memory_order_relaxed);
+        if (dropped > 0)
+            std::fprintf(stderr, "genalgo: Trace buffer of %s overflowed, %llu events dropped\n", name.c_str(), dropped);
+    }
+    traceStream << "\n]\n";
+    traceStream.close();
 }
 
 GA_NAMESPACE_END
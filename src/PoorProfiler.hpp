@@ -2,130 +2,310 @@
 #define GENALGO_POORPROFILER_HPP
 
 #include "base.hpp"
-#include <string>
-#include <string_view>
-#include <vector>
-#include <unordered_map>
+#include "PerfCounters.hpp"
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 GA_NAMESPACE_BEGIN
 
-class ProfilerStopwatch {
-    using steady_clock = std::chrono::steady_clock;
-    using time_point = std::chrono::time_point<steady_clock>;
-    using duration = std::chrono::duration<double>;
-public:
-    std::string_view name() const { return name_; }
-    double elapsed() const { return elapsed_; }
+// Profiler zones are registered at compile time: X(id, display name, parent)
+// Zones must be listed in depth-first order, the log prints them in this order.
+#define GA_PROFILER_ZONES(X)                                            \
+    X(loop,                 "loop",                 none)               \
+    X(evaluation,           "evaluation",           loop)               \
+    X(cull,                 "Cull",                 evaluation)         \
+    X(cudaPrepare,          "Prepare",              evaluation)         \
+    X(cudaCopy2Device,      "Copy",                 evaluation)         \
+    X(cudaDraw,             "Draw",                 evaluation)         \
+    X(cudaCompute,          "Compute",              evaluation)         \
+    X(cudaCopy2Individuals, "Copy to individuals",  evaluation)         \
+    X(cudaCleanup,          "Cleanup",              evaluation)         \
+    X(cpuClear,             "Clear",                evaluation)         \
+    X(cpuRasterize,         "Rasterize",            evaluation)         \
+    X(cpuScore,             "Score",                evaluation)         \
+    X(errorGuide,           "Error guide",          loop)               \
+    X(prune,                "Prune",                loop)               \
+    X(render,               "Render",               loop)               \
+    X(timelapse,            "Timelapse",            loop)               \
+    X(breed,                "Breed",                loop)               \
+    X(rendererUpdate,       "Renderer update",      none)
+
+enum class ProfilerZone : u16 {
+#define GA_PROFILER_ZONE_ENUM(id, name, parent) id,
+    GA_PROFILER_ZONES(GA_PROFILER_ZONE_ENUM)
+#undef GA_PROFILER_ZONE_ENUM
+    count,
+    none = count
+};
+
+constexpr i32 PROFILER_ZONE_COUNT = static_cast<i32>(ProfilerZone::count);
+
+namespace profiler_detail {
+
+struct ZoneInfo {
+    const char* key;
+    const char* name;
+    ProfilerZone parent;
+};
+
+inline constexpr ZoneInfo zoneInfo[PROFILER_ZONE_COUNT] = {
+#define GA_PROFILER_ZONE_INFO(id, name, parent) { #id, name, ProfilerZone::parent },
+    GA_PROFILER_ZONES(GA_PROFILER_ZONE_INFO)
+#undef GA_PROFILER_ZONE_INFO
+};
+
+}
+
+constexpr ProfilerZone profilerZoneParent(ProfilerZone zone) {
+    return profiler_detail::zoneInfo[static_cast<i32>(zone)].parent;
+}
 
-    bool parentIs(const ProfilerStopwatch* other) const {
-        return parent_ == other;
+// Identifier of the zone, stable for machine-readable outputs
+constexpr const char* profilerZoneKey(ProfilerZone zone) {
+    return profiler_detail::zoneInfo[static_cast<i32>(zone)].key;
+}
+
+// Root zones have depth 0
+constexpr i32 profilerZoneDepth(ProfilerZone zone) {
+    i32 depth = 0;
+    while ((zone = profilerZoneParent(zone)) != ProfilerZone::none)
+        ++depth;
+    return depth;
+}
+
+// Whether zone is ancestor or one of its descendants
+constexpr bool profilerZoneIsWithin(ProfilerZone zone, ProfilerZone ancestor) {
+    for (; zone != ProfilerZone::none; zone = profilerZoneParent(zone)) {
+        if (zone == ancestor)
+            return true;
     }
+    return false;
+}
+
+inline u64 profilerNowNs() {
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Statistics of a zone, aggregated over all threads. Times are in seconds.
+struct ProfilerZoneStats {
+    u64 count = 0;
+    f64 elapsed = 0;
+    f64 p50 = 0;
+    f64 p99 = 0;
+    f64 max = 0;
 
-    void reset() {
-        elapsed_ = 0;
+    // Hardware counters, only meaningful if the bit of the counter is set in perfMask
+    u32 perfMask = 0;
+    u64 perf[PERF_COUNTER_COUNT] = {};
+
+    bool hasPerf(PerfCounter counter) const {
+        return perfMask & (1u << static_cast<i32>(counter));
     }
 
-private:
-    void restart() {
-        startTime_ = std::chrono::steady_clock::now();
+    u64 getPerf(PerfCounter counter) const {
+        return perf[static_cast<i32>(counter)];
     }
+};
+
+struct ProfilerReport {
+    std::array<ProfilerZoneStats, PROFILER_ZONE_COUNT> zones;
+
+    ProfilerZoneStats const& operator[](ProfilerZone zone) const {
+        return zones[static_cast<i32>(zone)];
+    }
+};
+
+// State of a single thread. It's only written by the thread that owns it,
+// other threads can read the counters at any time.
+class ProfilerThread {
+public:
+    static constexpr i32 MAX_DEPTH = 32;
 
-    void trigger() {
-        time_point endTime = steady_clock::now();
+    // Log-linear histogram: 4 buckets for each power of two (in nanoseconds)
+    static constexpr i32 HISTOGRAM_SUB_BITS = 2;
+    static constexpr i32 HISTOGRAM_BUCKETS = 64 << HISTOGRAM_SUB_BITS;
 
-        duration elapsed = endTime - startTime_;
-        elapsed_ += std::chrono::duration_cast<duration>(elapsed).count();
+    // Number of trace events buffered per thread, must be a power of two
+    static constexpr u64 TRACE_CAPACITY = 1 << 16;
+
+    struct ZoneCounters {
+        std::atomic<u64> count;
+        std::atomic<u64> totalNs;
+        std::atomic<u64> maxNs;
+        std::atomic<u64> histogram[HISTOGRAM_BUCKETS];
+        std::atomic<u64> perf[PERF_COUNTER_COUNT];
+    };
+
+    struct TraceEvent {
+        u64 startNs;
+        u64 endNs;
+        ProfilerZone zone;
+    };
+
+    void push(ProfilerZone zone, bool perf) {
+        if (depth == MAX_DEPTH)
+            throw_too_deep();
+
+        // Counters are read before the clock, so the syscall is not part of the zone time
+        ActiveZone& active = stack[depth++];
+        active.zone = zone;
+        active.perf = perf && readPerf(active.perfValues);
+        active.startNs = profilerNowNs();
     }
 
-    ProfilerStopwatch(std::string_view name, ProfilerStopwatch* parent)
-        : name_(name), parent_(parent), elapsed_(0) { }
+    void pop(ProfilerZone zone, u64 endNs, bool trace) {
+        if (depth == 0 || stack[depth - 1].zone != zone)
+            throw_bad_pop(zone);
+        record(stack[--depth], endNs, trace);
+    }
+
+    static i32 histogramBucket(u64 ns);
+    static u64 histogramBucketValue(i32 bucket);
 
-    std::string name_;
-    ProfilerStopwatch* parent_;
-    time_point startTime_;
-    double elapsed_;
+private:
     friend class PoorProfiler;
+
+    struct ActiveZone {
+        ProfilerZone zone;
+        bool perf;
+        u64 startNs;
+        u64 perfValues[PERF_COUNTER_COUNT];
+    };
+
+    void record(ActiveZone const& active, u64 endNs, bool trace);
+
+    // Opens the counters of the thread on the first call
+    bool readPerf(u64 values[PERF_COUNTER_COUNT]);
+
+    [[noreturn]] static void throw_too_deep();
+    [[noreturn]] static void throw_bad_pop(ProfilerZone zone);
+
+    ActiveZone stack[MAX_DEPTH];
+    i32 depth = 0;
+
+    ZoneCounters zones[PROFILER_ZONE_COUNT];
+
+    // Single-producer/single-consumer ring buffer of trace events
+    std::unique_ptr<TraceEvent[]> events;
+    std::atomic<u64> eventsHead;
+    std::atomic<u64> eventsTail;
+    std::atomic<u64> eventsDropped;
+
+    std::unique_ptr<PerfCounters> perfCounters;
+    bool perfOpened = false;
+    std::atomic<u32> perfMask;
+
+    u32 id = 0;
+    const char* name = nullptr;
 };
 
+// Thread-safe profiler. Zones can be started and stopped from any thread,
+// the statistics are collected (and trace events written) by a single reader thread.
 class PoorProfiler {
 public:
-    PoorProfiler() {
-        stopwatches.reserve(32);
-    }
+    PoorProfiler();
+    ~PoorProfiler();
 
-    void start(const char* name, const char* display) {
-        ProfilerStopwatch* sw;
-        auto it = stopwatchesMap.find(name);
-        if (it == stopwatchesMap.end())
-            sw = &newStopwatch(name, display);
-        else
-            sw = it->second;
+    PoorProfiler(const PoorProfiler&) = delete;
+    PoorProfiler& operator=(const PoorProfiler&) = delete;
 
-        activeStopwatches.push_back(sw);
-        sw->restart();
+    void start(ProfilerZone zone) {
+        local().push(zone, perfEnabled.load(std::memory_order_relaxed));
     }
 
-    void start(const char* name) {
-        start(name, name);
+    void stop(ProfilerZone zone) {
+        u64 now = profilerNowNs();
+        local().pop(zone, now, tracing.load(std::memory_order_relaxed));
     }
 
-    void stop(const char* name) {
-        auto it = stopwatchesMap.find(name);
-        if (it == stopwatchesMap.end())
-            throw_bad_stopwatch();
-        ProfilerStopwatch* sw = it->second;
-        if (activeStopwatches.empty() || activeStopwatches.back() != sw)
-            throw_bad_pop(name);
-        activeStopwatches.pop_back();
-        sw->trigger();
+    // Samples hardware counters (cycles, instructions, LLC and branch misses) in every zone.
+    // Each thread opens its counters on its next zone, threads that can't open them
+    // (e.g. perf_event_paranoid, containers) silently report no counters.
+    void enablePerfCounters() {
+        perfEnabled.store(true, std::memory_order_relaxed);
     }
 
-    ProfilerStopwatch& getStopwatch(const char* name) {
-        auto it = stopwatchesMap.find(name);
-        if (it == stopwatchesMap.end())
-            throw_bad_stopwatch();
-        return *it->second;
+    // Display name for the zone, the name must outlive the profiler
+    void setDisplayName(ProfilerZone zone, const char* name) {
+        displayNames[static_cast<i32>(zone)] = name;
     }
 
-    std::vector<ProfilerStopwatch> const& getStopwatches() const {
-        return stopwatches;
+    const char* getDisplayName(ProfilerZone zone) const {
+        return displayNames[static_cast<i32>(zone)];
     }
 
-    std::vector<ProfilerStopwatch>& getStopwatches() {
-        return stopwatches;
+    // Name of the calling thread in the trace, the name must outlive the profiler
+    void setThreadName(const char* name) {
+        local().name = name;
     }
+
+    // Statistics of all zones since the last call. Must be called by a single thread.
+    ProfilerReport collect();
+
+    // Chrome trace (also readable by Perfetto)
+    // Events are buffered by each thread and written to the file by flushTrace().
+    bool startTrace(const char* filename);
+    void flushTrace();
+    void stopTrace();
+
 private:
-    std::vector<ProfilerStopwatch*> activeStopwatches;
-    std::unordered_map<const char*, ProfilerStopwatch*> stopwatchesMap;
-    std::vector<ProfilerStopwatch> stopwatches;
+    ProfilerThread& local() {
+        thread_local PoorProfiler* owner = nullptr;
+        thread_local ProfilerThread* thread = nullptr;
+        if (owner != this) {
+            thread = &registerThread();
+            owner = this;
+        }
+        return *thread;
+    }
 
-    ProfilerStopwatch& newStopwatch(const char* name, const char* display);
-    [[noreturn]] void throw_bad_stopwatch();
-    [[noreturn]] void throw_bad_pop(const char* name);
+    ProfilerThread& registerThread();
+
+    std::array<const char*, PROFILER_ZONE_COUNT> displayNames;
+
+    std::mutex threadsMutex;
+    std::vector<std::unique_ptr<ProfilerThread>> threads;
+
+    // Reader side: counters seen by the last collect(), per thread
+    struct ZoneSnapshot {
+        u64 count = 0;
+        u64 totalNs = 0;
+        u64 histogram[ProfilerThread::HISTOGRAM_BUCKETS] = {};
+        u64 perf[PERF_COUNTER_COUNT] = {};
+    };
+    std::vector<std::unique_ptr<std::array<ZoneSnapshot, PROFILER_ZONE_COUNT>>> snapshots;
+
+    std::atomic<bool> perfEnabled;
+
+    std::atomic<bool> tracing;
+    std::ofstream traceStream;
+    u64 traceEpochNs = 0;
+    bool traceSeparator = false;
 };
 
 extern PoorProfiler profiler;
 
 class ProfilerGuard {
 public:
-    ProfilerGuard(PoorProfiler& prof, const char* name, const char* display)
-        : name(name), prof(prof) {
-        prof.start(name, display);
+    ProfilerGuard(PoorProfiler& prof, ProfilerZone zone)
+        : zone(zone), prof(prof) {
+        prof.start(zone);
     }
-    ProfilerGuard(PoorProfiler& prof, const char* name)
-        : ProfilerGuard(prof, name, name) { }
 
-    ProfilerGuard(const char* name, const char* display)
-        : ProfilerGuard(profiler, name, display) { }
-    ProfilerGuard(const char* name)
-        : ProfilerGuard(profiler, name, name) { }
+    ProfilerGuard(ProfilerZone zone)
+        : ProfilerGuard(profiler, zone) { }
 
     ~ProfilerGuard() {
-        prof.stop(name);
+        prof.stop(zone);
     }
 private:
-    const char* name;
+    ProfilerZone zone;
     PoorProfiler& prof;
 };
 
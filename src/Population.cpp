@@ -1,8 +1,11 @@
 #include "Population.hpp"
+#include "ColorRefit.hpp"
 #include "GlobalConfig.hpp"
+#include "Lineage.hpp"
 #include "globalRNG.hpp"
 #include <algorithm>
 #include <stdexcept>
+#include <utility>
 #include "FitnessEngine.hpp"
 #include "JSONSerializer/vector_serializer.hpp"
 #include "JSONDeserializer/vector_deserializer.hpp"
@@ -66,22 +69,79 @@ Population Population::breed() const {
     Population nextGen;
     nextGen.individuals.reserve(individuals.size());
 
-    for (i32 i = 0; i < ELITE; ++i)
+    for (i32 i = 0; i < ELITE; ++i) {
         nextGen.individuals.push_back(individuals[idx[i]]);
+        nextGen.individuals.back().clearAppliedMutations();
+        if (globalCfg.lineage)
+            lineage.recordChild(i, idx[i], -1, individuals[idx[i]].getWeightedFitness(), nextGen.individuals.back());
+    }
 
     std::uniform_int_distribution<i32> dist(0, globalCfg.breedPoolSize - 1);
+    static ColorRefit colorRefit;
 
     while (nextGen.individuals.size() < individuals.size()) {
         i32 parent1 = dist(globalRNG);
         i32 parent2 = dist(globalRNG);
 
         Individual child = individuals[idx[parent1]].crossover(individuals[idx[parent2]]);
-        nextGen.individuals.push_back(child);
+
+        // Lamarckian step: children are improved before they are scored
+        for (i32 i = 0; i < globalCfg.refitTriangles && child.size() > 0; ++i)
+            colorRefit.refit(child, randomI32(0, child.size() - 1));
+
+        if (globalCfg.lineage) {
+            f64 parentFitness = std::min(individuals[idx[parent1]].getWeightedFitness(),
+                                         individuals[idx[parent2]].getWeightedFitness());
+            lineage.recordChild(nextGen.individuals.size(), idx[parent1], idx[parent2], parentFitness, child);
+        }
+        nextGen.individuals.push_back(std::move(child));
     }
 
     return nextGen;
 }
 
+PruneReport Population::prune(i32 count, f64 threshold) {
+    PruneReport report;
+    count = std::min<i32>(count, individuals.size());
+    if (count <= 0)
+        return report;
+
+    std::vector<i32> idx(individuals.size());
+    for (i32 i = 0; i < static_cast<i32>(individuals.size()); ++i)
+        idx[i] = i;
+    std::partial_sort(idx.begin(), idx.begin() + count, idx.end(), [this](i32 i, i32 j) {
+        return individuals[i].getWeightedFitness() < individuals[j].getWeightedFitness();
+    });
+
+    static Pruner pruner;
+    std::vector<Individual> changed;
+    std::vector<i32> changedIdx;
+    for (i32 k = 0; k < count; ++k) {
+        Individual& individual = individuals[idx[k]];
+        i32 removed = pruner.prune(individual, threshold, k == 0 ? &report.contributions : nullptr);
+        if (k == 0)
+            report.savedFraction = pruner.getSavedFraction();
+        if (removed == 0)
+            continue;
+
+        report.removed += removed;
+        ++report.pruned;
+        if (k == 0)
+            report.best = idx[0];
+        changed.push_back(individual);
+        changedIdx.push_back(idx[k]);
+    }
+
+    if (!changed.empty()) {
+        FitnessEngine::evaluateReference(changed);
+        for (std::size_t k = 0; k < changed.size(); ++k) {
+            individuals[changedIdx[k]].setFitness(changed[k].getFitness());
+            individuals[changedIdx[k]].setWeightedFitness(changed[k].getWeightedFitness());
+        }
+    }
+    return report;
+}
+
 void serialize(JSONSerializerState& state, Population const& self) {
     state.serialize(self.individuals);
 }
@@ -4,6 +4,7 @@
 #include "JSONSerializer.hpp"
 #include "base.hpp"
 #include "Individual.hpp"
+#include "Pruner.hpp"
 
 GA_NAMESPACE_BEGIN
 
@@ -23,6 +24,10 @@ public:
 
     Population breed() const;
 
+    // Prunes the count best individuals (see Pruner.hpp), then scores those that changed
+    // with FitnessEngine::evaluateReference. Their order in the population doesn't change.
+    PruneReport prune(i32 count, f64 threshold);
+
     friend void serialize(JSONSerializerState& state, const Population& population);
     friend void deserialize(JSONDeserializerState& state, Population& population);
 private:
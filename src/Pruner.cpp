@@ -0,0 +1,104 @@
+#include "Pruner.hpp"
+
+#include "GlobalConfig.hpp"
+#include "Rasterizer.hpp"
+#include <algorithm>
+
+GA_NAMESPACE_BEGIN
+
+f64 Pruner::contribution(Individual& individual, i32 index) {
+    const i32 width = globalCfg.targetImage.getWidth();
+    const i32 height = globalCfg.targetImage.getHeight();
+
+    // Through a const reference, the non-const accessors would invalidate the spatial index
+    Individual const& triangles = individual;
+    rasterizer::BoundingBox box = rasterizer::boundingBox(triangles[index], width, height);
+    if (box.area() == 0)
+        return 0;
+
+    if (globalCfg.spatialIndex) {
+        individual.getSpatialIndex().overlapping(box.minX, box.minY, box.maxX, box.maxY, candidates);
+    } else {
+        candidates.clear();
+        for (i32 j = 0; j < triangles.size(); ++j) {
+            if (rasterizer::overlaps(box, rasterizer::boundingBox(triangles[j], width, height)))
+                candidates.push_back(j);
+        }
+    }
+
+    // The box is rasterized on its own, with the triangles translated to its origin. The
+    // coverage test only depends on the differences of the coordinates, so it is unchanged.
+    const i32 boxWidth = box.maxX - box.minX + 1;
+    const i32 boxHeight = box.maxY - box.minY + 1;
+    const i32 size = boxWidth * boxHeight;
+    Vec3d const* fullTarget = globalCfg.targetImage.getPremultiplied();
+    f64 const* fullWeights = globalCfg.targetImage.getWeights();
+    target.resize(size);
+    weights.resize(size);
+    for (i32 y = 0; y < boxHeight; ++y) {
+        i32 offset = (box.minY + y) * width + box.minX;
+        std::copy_n(fullTarget + offset, boxWidth, target.begin() + y * boxWidth);
+        std::copy_n(fullWeights + offset, boxWidth, weights.begin() + y * boxWidth);
+    }
+
+    with.resize(size);
+    without.resize(size);
+    rasterizer::clear(with.data(), size);
+    Point<i32> origin {box.minX, box.minY};
+    for (i32 j : candidates) {
+        Triangle t = triangles[j];
+        t.a = t.a - origin;
+        t.b = t.b - origin;
+        t.c = t.c - origin;
+
+        // Both canvases are the same up to the triangle
+        if (j == index)
+            std::copy_n(with.begin(), size, without.begin());
+        rasterizer::rasterize(with.data(), t, boxWidth, boxHeight);
+        if (j > index)
+            rasterizer::rasterize(without.data(), t, boxWidth, boxHeight);
+    }
+
+    errorWith.resize(size);
+    errorWithout.resize(size);
+    return visitFitnessMetric(globalCfg.fitnessMetric, [&](auto policy) {
+        using Metric = decltype(policy);
+        rasterizer::residual<Metric>(errorWith.data(), with.data(), target.data(), weights.data(), size);
+        rasterizer::residual<Metric>(errorWithout.data(), without.data(), target.data(), weights.data(), size);
+
+        f64 sum = 0;
+        for (i32 i = 0; i < size; ++i)
+            sum += errorWithout[i] - errorWith[i];
+        return sum;
+    });
+}
+
+i32 Pruner::prune(Individual& individual, f64 threshold, std::vector<f64>* contributions) {
+    const i32 width = globalCfg.targetImage.getWidth();
+    const i32 height = globalCfg.targetImage.getHeight();
+    Individual const& triangles = individual;
+
+    i64 totalArea = 0;
+    for (Triangle const& t : triangles)
+        totalArea += rasterizer::boundingBox(t, width, height).area();
+
+    // From the last one, so the indices of the ones left to check don't change
+    i32 removed = 0;
+    i64 removedArea = 0;
+    for (i32 i = triangles.size() - 1; i >= 0; --i) {
+        f64 c = contribution(individual, i);
+        if (contributions)
+            contributions->push_back(c);
+
+        if (c <= threshold && triangles.size() > 1) {
+            removedArea += rasterizer::boundingBox(triangles[i], width, height).area();
+            individual.erase(i);
+            ++removed;
+        }
+    }
+
+    savedFraction = totalArea > 0 ? static_cast<f64>(removedArea) / totalArea : 0;
+    return removed;
+}
+
+GA_NAMESPACE_END
@@ -0,0 +1,53 @@
+#ifndef GENALGO_PRUNER_HPP
+#define GENALGO_PRUNER_HPP
+
+#include "base.hpp"
+#include "Individual.hpp"
+#include "Vec.hpp"
+#include <vector>
+
+GA_NAMESPACE_BEGIN
+
+// Result of Population::prune
+struct PruneReport {
+    i32 pruned = 0;             // Individuals
+    i32 removed = 0;            // Triangles
+    f64 savedFraction = 0;      // Of the rasterization work of the best individual
+    i32 best = -1;              // Index of the best individual in the population, if pruned
+    std::vector<f64> contributions; // Of the triangles of the best individual
+};
+
+// Marginal contribution of the triangles of an individual to its fitness: how much the
+// error, before the finish() of the metric, grows when the triangle is removed. Only its
+// bounding box can change, so only the triangles overlapping it are rasterized, into a
+// canvas of the size of the box. Invisible triangles (transparent, degenerate, outside of
+// the image or covered by opaque ones) contribute exactly 0.
+class Pruner {
+public:
+    f64 contribution(Individual& individual, i32 index);
+
+    // Removes the triangles contributing at most threshold, from the last drawn to the first,
+    // each contribution computed after the previous removals. At least one triangle is kept.
+    // Appends the contributions to contributions, if not null, and returns the number of
+    // triangles removed.
+    i32 prune(Individual& individual, f64 threshold, std::vector<f64>* contributions = nullptr);
+
+    // Sum of the bounding box areas of the removed triangles by the last prune, over the one of
+    // all the triangles before it: the fraction of rasterization work saved
+    f64 getSavedFraction() const noexcept { return savedFraction; }
+private:
+    f64 savedFraction = 0;
+
+    // Scratch space, for the pixels of the bounding box
+    std::vector<i32> candidates;
+    std::vector<Vec3d> target;
+    std::vector<f64> weights;
+    std::vector<Vec3d> with;
+    std::vector<Vec3d> without;
+    std::vector<f64> errorWith;
+    std::vector<f64> errorWithout;
+};
+
+GA_NAMESPACE_END
+
+#endif // GENALGO_PRUNER_HPP
@@ -0,0 +1,241 @@
+#ifndef GENALGO_RASTERIZER_HPP
+#define GENALGO_RASTERIZER_HPP
+
+#include "base.hpp"
+#include "Color.hpp"
+#include "FitnessMetric.hpp"
+#include "Individual.hpp"
+#include "Point.hpp"
+#include "TileLayout.hpp"
+#include "Triangle.hpp"
+#include "Vec.hpp"
+#include <algorithm>
+#include <vector>
+
+GA_NAMESPACE_BEGIN
+
+// Reference rasterizer shared by the CPU fitness engines (and the benchmarks).
+// Canvases are width * height premultiplied RGB pixels over a black background.
+//
+// It also defines the fitness every engine must compute, up to rounding:
+//   - The target is premultiplied by its alpha (blended over black).
+//   - The triangles are blended in order over black. A triangle covers the pixel (x, y)
+//     if the point (x, y) passes pointInTriangle, edges and vertices included.
+//   - The fitness is the sum over all pixels of the squared RGB difference (metric::L2),
+//     or of the error of another metric (see FitnessMetric.hpp).
+// genalgo_bench diff checks the engines against it.
+namespace rasterizer {
+
+inline bool pointInTriangle(Point<i32> const& p, Point<i32> const& a, Point<i32> const& b, Point<i32> const& c) {
+    auto sign = [](Point<i32> const& p1, Point<i32> const& p2, Point<i32> const& p3) {
+        return (p1.x - p3.x) * (p2.y - p3.y) - (p2.x - p3.x) * (p1.y - p3.y);
+    };
+
+    bool b1, b2, b3;
+
+    b1 = sign(p, a, b) < 0;
+    b2 = sign(p, b, c) < 0;
+    b3 = sign(p, c, a) < 0;
+
+    return ((b1 == b2) && (b2 == b3));
+}
+
+inline Vec3d blend(Vec3d dst, Vec3d src, u8 srcAlpha) {
+    // Equivalent: glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    f64 alpha = srcAlpha / 255.0;
+    return alpha * src + (1.0 - alpha) * dst;
+}
+
+inline Vec3d fromColor(Color c) {
+    return Vec3d{1.0 * c.r, 1.0 * c.g, 1.0 * c.b};
+}
+
+// Target image as seen by the fitness: RGBA blended over black
+inline void premultiply(Vec3d dst[], Color const* target, i32 size) {
+    for (i32 i = 0; i < size; ++i)
+        dst[i] = blend({0, 0, 0}, fromColor(target[i]), target[i].a);
+}
+
+// Inclusive pixel bounds, empty if minX > maxX or minY > maxY
+struct BoundingBox {
+    i32 minX, minY, maxX, maxY;
+
+    i64 area() const noexcept {
+        return minX > maxX || minY > maxY ? 0 : static_cast<i64>(maxX - minX + 1) * (maxY - minY + 1);
+    }
+};
+
+// Bounding box of the pixels the triangle may cover, clipped to the image
+inline BoundingBox boundingBox(Triangle const& t, i32 width, i32 height) {
+    return {
+        std::max(0, std::min({t.a.x, t.b.x, t.c.x})),
+        std::max(0, std::min({t.a.y, t.b.y, t.c.y})),
+        std::min(width - 1, std::max({t.a.x, t.b.x, t.c.x})),
+        std::min(height - 1, std::max({t.a.y, t.b.y, t.c.y}))
+    };
+}
+
+inline bool overlaps(BoundingBox const& a, BoundingBox const& b) {
+    return a.minX <= b.maxX && b.minX <= a.maxX && a.minY <= b.maxY && b.minY <= a.maxY;
+}
+
+inline void clear(Vec3d dst[], i32 size) {
+    for (i32 i = 0; i < size; ++i)
+        dst[i] = Vec3d{0, 0, 0};
+}
+
+// Only the pixels of the triangle in the rectangle [x0, x1] x [y0, y1] of the image, into a
+// canvas of stride pixels per row whose first pixel is (originX, originY): the image itself
+// from (0, 0), or a canvas of the rectangle alone from (x0, y0)
+inline void rasterize(Vec3d dst[], Triangle const& t, i32 stride, i32 originX, i32 originY, i32 x0, i32 y0, i32 x1, i32 y1) {
+    Vec3d color = fromColor(t.color);
+    u8 alpha = t.color.a;
+
+    // Determine the bounding box of the triangle
+    i32 minX = std::max(x0, std::min({t.a.x, t.b.x, t.c.x}));
+    i32 minY = std::max(y0, std::min({t.a.y, t.b.y, t.c.y}));
+    i32 maxX = std::min(x1, std::max({t.a.x, t.b.x, t.c.x}));
+    i32 maxY = std::min(y1, std::max({t.a.y, t.b.y, t.c.y}));
+
+    // Iterate over pixels in the bounding box
+    for (i32 y = minY; y <= maxY; ++y) {
+        for (i32 x = minX; x <= maxX; ++x) {
+            // Check if the pixel is inside the triangle
+            if (pointInTriangle({x, y}, t.a, t.b, t.c)) {
+                i32 index = (y - originY) * stride + x - originX;
+                // Blend the triangle color with the destination buffer
+                dst[index] = blend(dst[index], color, alpha);
+            }
+        }
+    }
+}
+
+inline void rasterize(Vec3d dst[], Triangle const& t, i32 width, i32 height) {
+    rasterize(dst, t, width, 0, 0, 0, 0, width - 1, height - 1);
+}
+
+inline void rasterize(Vec3d dst[], Individual const& individual, i32 width, i32 height) {
+    for (const Triangle& t : individual)
+        rasterize(dst, t, width, height);
+}
+
+// Scratch space of rasterizeFrontToBack: the transmittance of each pixel, the number of
+// pixels of each TILE_SIZE x TILE_SIZE tile it stopped at, and whether all of them did
+struct FrontToBackState {
+    std::vector<f64> transmittance;
+    std::vector<i32> stopped;
+    std::vector<u8> saturated;
+};
+
+// Same canvas as clear() then rasterize(), up to rounding, with the triangles composited
+// from the last to the first: dst += T * alpha * color, then T *= 1 - alpha, from T = 1.
+// A pixel stops once T <= minTransmittance, which changes it by at most
+// minTransmittance * 255 per channel: nothing for 0, reached behind an opaque triangle.
+// Triangles skip the tiles whose pixels all stopped, and the rest of the triangles are
+// skipped once all the tiles are.
+inline void rasterizeFrontToBack(Vec3d dst[], FrontToBackState& state, Individual const& individual, i32 width, i32 height, f64 minTransmittance) {
+    const i32 tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+    const i32 tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+    state.transmittance.assign(static_cast<std::size_t>(width) * height, 1.0);
+    state.stopped.assign(tilesX * tilesY, 0);
+    state.saturated.assign(tilesX * tilesY, 0);
+    clear(dst, width * height);
+    f64* transmittances = state.transmittance.data();
+
+    i32 saturatedTiles = 0;
+    for (i32 i = individual.size() - 1; i >= 0 && saturatedTiles < tilesX * tilesY; --i) {
+        Triangle const& t = individual[i];
+        Vec3d color = fromColor(t.color);
+        f64 alpha = t.color.a / 255.0;
+
+        i32 minX = std::max(0, std::min({t.a.x, t.b.x, t.c.x}));
+        i32 minY = std::max(0, std::min({t.a.y, t.b.y, t.c.y}));
+        i32 maxX = std::min(width - 1, std::max({t.a.x, t.b.x, t.c.x}));
+        i32 maxY = std::min(height - 1, std::max({t.a.y, t.b.y, t.c.y}));
+        if (t.color.a == 0 || minX > maxX || minY > maxY)
+            continue;
+
+        for (i32 tileY = minY / TILE_SIZE; tileY <= maxY / TILE_SIZE; ++tileY) {
+            for (i32 tileX = minX / TILE_SIZE; tileX <= maxX / TILE_SIZE; ++tileX) {
+                i32 tile = tileY * tilesX + tileX;
+                if (state.saturated[tile])
+                    continue;
+
+                i32 tileWidth = std::min(TILE_SIZE, width - tileX * TILE_SIZE);
+                i32 tileHeight = std::min(TILE_SIZE, height - tileY * TILE_SIZE);
+                i32 y0 = std::max(minY, tileY * TILE_SIZE);
+                i32 y1 = std::min(maxY, tileY * TILE_SIZE + TILE_SIZE - 1);
+                i32 x0 = std::max(minX, tileX * TILE_SIZE);
+                i32 x1 = std::min(maxX, tileX * TILE_SIZE + TILE_SIZE - 1);
+                i32 stopped = state.stopped[tile];
+                for (i32 y = y0; y <= y1; ++y) {
+                    for (i32 x = x0; x <= x1; ++x) {
+                        i32 index = y * width + x;
+                        f64 transmittance = transmittances[index];
+                        if (transmittance <= minTransmittance || !pointInTriangle({x, y}, t.a, t.b, t.c))
+                            continue;
+
+                        dst[index] += (transmittance * alpha) * color;
+                        transmittance *= 1.0 - alpha;
+                        transmittances[index] = transmittance;
+                        stopped += transmittance <= minTransmittance;
+                    }
+                }
+
+                state.stopped[tile] = stopped;
+                if (stopped == tileWidth * tileHeight) {
+                    state.saturated[tile] = 1;
+                    ++saturatedTiles;
+                }
+            }
+        }
+    }
+}
+
+// Sum of the errors of the pixels of the canvas dst against the target src, before the
+// finish() of the metric. weights is only read by weighted metrics.
+template <typename Metric>
+inline f64 errorSum(Vec3d const dst[], Vec3d const src[], f64 const weights[], i32 size) {
+    f64 sum = 0.0;
+    for (i32 i = 0; i < size; ++i) {
+        Vec3d diff = dst[i] - src[i];
+        if constexpr (Metric::weighted)
+            sum += Metric::error(diff) * (1.0 + weights[i]);
+        else
+            sum += Metric::error(diff);
+    }
+    return sum;
+}
+
+// Error of the canvas dst against the target src
+template <typename Metric>
+inline f64 score(Vec3d const dst[], Vec3d const src[], f64 const weights[], i32 size) {
+    return Metric::finish(errorSum<Metric>(dst, src, weights, size));
+}
+
+// Error of each pixel of the canvas dst against the target src, the terms of the sum of score()
+template <typename Metric>
+inline void residual(f64 out[], Vec3d const dst[], Vec3d const src[], f64 const weights[], i32 size) {
+    for (i32 i = 0; i < size; ++i) {
+        Vec3d diff = dst[i] - src[i];
+        if constexpr (Metric::weighted)
+            out[i] = Metric::error(diff) * (1.0 + weights[i]);
+        else
+            out[i] = Metric::error(diff);
+    }
+}
+
+// Reference fitness of an individual, canvas is scratch space of width * height pixels
+template <typename Metric>
+inline f64 fitness(Vec3d canvas[], Vec3d const target[], f64 const weights[], Individual const& individual, i32 width, i32 height) {
+    clear(canvas, width * height);
+    rasterize(canvas, individual, width, height);
+    return score<Metric>(canvas, target, weights, width * height);
+}
+
+}
+
+GA_NAMESPACE_END
+
+#endif // GENALGO_RASTERIZER_HPP
@@ -1,5 +1,6 @@
 #include "SFMLRenderer.hpp"
 #include "GlobalConfig.hpp"
+#include "PoorProfiler.hpp"
 
 #include <cmath>
 #include <cstring>
@@ -74,6 +75,8 @@ static void transform(sf::Color* data, f64* weights, i32 width, i32 height) {
 }
 
 void SFMLRenderer::RendererImpl::renderLoop() {
+    profiler.setThreadName("render");
+
     i32 width = globalCfg.targetImage.getWidth();
     i32 height = globalCfg.targetImage.getHeight();
 
@@ -142,18 +145,21 @@ void SFMLRenderer::RendererImpl::renderLoop() {
                     window.setSize(sf::Vector2u(width * scale * (showOriginal ? 2 : 1), height * scale));
                 } else if (event.key.code == sf::Keyboard::R) {
                     index = -1;
+                    self.requestedIndex.store(index, std::memory_order_relaxed);
                     window.setTitle("Genetic Algorithm - Best Individual");
                     update();
                 } else if (event.key.code == sf::Keyboard::N) {
                     index++;
                     if (index >= globalCfg.populationSize)
                         index = 0;
+                    self.requestedIndex.store(index, std::memory_order_relaxed);
                     window.setTitle("Genetic Algorithm - Individual #" + std::to_string(index));
                     update();
                 } else if (event.key.code == sf::Keyboard::P) {
                     index--;
                     if (index < 0)
                         index = globalCfg.populationSize - 1;
+                    self.requestedIndex.store(index, std::memory_order_relaxed);
                     window.setTitle("Genetic Algorithm - Individual #" + std::to_string(index));
                     update();
                 } else if (event.key.code == sf::Keyboard::Up) {
@@ -181,15 +187,21 @@ void SFMLRenderer::RendererImpl::renderLoop() {
 }
 
 void SFMLRenderer::RendererImpl::processRenderRequest() {
-    if (!self.renderRequested)
-        return;
-
-    update();
-    self.renderRequested = false;
+    if (self.snapshots.acquire())
+        update();
 }
 
 void SFMLRenderer::RendererImpl::update() {
-    auto& individual = index == -1 ? self.bestIndividual : self.population.getIndividuals()[index];
+    Snapshot const& snapshot = self.snapshots.front();
+
+    // The requested individual is only available after the next snapshot,
+    // keep displaying the current one until then.
+    if (index != -1 && snapshot.index != index)
+        return;
+
+    ProfilerGuard guard(ProfilerZone::rendererUpdate);
+
+    auto& individual = index == -1 ? snapshot.best : snapshot.selected;
     i32 width = globalCfg.targetImage.getWidth();
     i32 height = globalCfg.targetImage.getHeight();
 
@@ -210,11 +222,30 @@ void SFMLRenderer::RendererImpl::update() {
 }
 
 SFMLRenderer::SFMLRenderer()
-    : renderRequested(false),
+    : requestedIndex(-1),
       renderExited(false),
       impl(std::make_unique<RendererImpl>(*this))
 { }
 
+void SFMLRenderer::requestRender(i64 nGen, Individual const& best, Population const& pop) {
+    Snapshot& snapshot = snapshots.back();
+
+    // Copy-assignment reuses the capacity of the slot, only the individuals
+    // that are actually displayed are copied.
+    snapshot.best = best;
+
+    auto& individuals = pop.getIndividuals();
+    i32 index = requestedIndex.load(std::memory_order_relaxed);
+    if (index >= 0 && index < static_cast<i32>(individuals.size())) {
+        snapshot.index = index;
+        snapshot.selected = individuals[index];
+    } else {
+        snapshot.index = -1;
+    }
+
+    snapshots.publish();
+}
+
 SFMLRenderer::~SFMLRenderer() = default;
 
 GA_NAMESPACE_END
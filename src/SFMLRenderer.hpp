@@ -3,6 +3,7 @@
 
 #include "base.hpp"
 #include "Population.hpp"
+#include "TripleBuffer.hpp"
 #include <atomic>
 #include <memory>
 
@@ -13,23 +14,25 @@ public:
     SFMLRenderer();
     ~SFMLRenderer(); 
 
-    bool requestRender(i32 nGen, Individual& best, Population& pop) {
-        if (renderRequested)
-            return false;
-        bestIndividual = best;
-        population = pop;
-        renderRequested = true;
-        return true;
-    }
+    // Publishes a snapshot of the best individual (and of the individual currently
+    // browsed in the window, if any) to the render thread. Never blocks.
+    void requestRender(i64 nGen, Individual const& best, Population const& pop);
 
     bool exited() const {
         return renderExited.load(std::memory_order_relaxed);
     }
 private:
-    std::atomic<bool> renderRequested;
+    struct Snapshot {
+        Individual best;
+
+        // Individual requested by the render thread, -1 if none
+        i32 index = -1;
+        Individual selected;
+    };
+
+    TripleBuffer<Snapshot> snapshots;
+    std::atomic<i32> requestedIndex;
     std::atomic<bool> renderExited;
-    Individual bestIndividual;
-    Population population;
 
     class RendererImpl;
     std::unique_ptr<RendererImpl> impl;
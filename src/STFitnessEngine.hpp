@@ -3,22 +3,39 @@
 
 #include "FitnessEngine.hpp"
 
+#include "FitnessMetric.hpp"
+#include "FixedPoint.hpp"
 #include "Vec.hpp"
+#include <vector>
 
 GA_NAMESPACE_BEGIN
 
+template <typename Metric = metric::L2>
 class STFitnessEngine final : public FitnessEngine {
 public:
-    STFitnessEngine() = default;
+    STFitnessEngine();
     ~STFitnessEngine() override = default;
 
     virtual const char* getEngineName() const noexcept override {
         return "STFitnessEngine";
     }
 
+    virtual const char* getMetricName() const noexcept override {
+        return Metric::name;
+    }
+
     void evaluate_impl(std::vector<Individual>& individuals) override;
+private:
+    // With globalCfg.fixedPoint: the canvas, and the target converted once
+    std::vector<fixedpoint::Pixel> fixedDst;
+    std::vector<fixedpoint::Pixel> fixedTarget;
 };
 
+// Instantiated in STFitnessEngine.cpp
+#define GA_ST_EXTERN(M) extern template class STFitnessEngine<metric::M>;
+GA_FITNESS_METRICS(GA_ST_EXTERN)
+#undef GA_ST_EXTERN
+
 GA_NAMESPACE_END
 
 #endif // GENALGO_STFITNESSENGINE_HPP
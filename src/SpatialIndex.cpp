@@ -0,0 +1,284 @@
+#include "SpatialIndex.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+GA_NAMESPACE_BEGIN
+
+// Bounds the memory of the grid when there are many triangles
+constexpr i32 MAX_GRID_CELLS = 4096;
+
+static Point<i32> centroid(Triangle const& t) {
+    return (t.a + t.b + t.c) / 3;
+}
+
+static void eraseValue(std::vector<i32>& list, i32 value) {
+    auto it = std::find(list.begin(), list.end(), value);
+    if (it != list.end()) {
+        *it = list.back();
+        list.pop_back();
+    }
+}
+
+void SpatialIndex::build(std::vector<Triangle> const& triangles, i32 width, i32 height) {
+    this->width = width;
+    this->height = height;
+
+    // About one triangle per cell, with square cells
+    const i32 n = static_cast<i32>(triangles.size());
+    const i32 target = std::clamp(n, 1, MAX_GRID_CELLS);
+    cellWidth = std::max(1, static_cast<i32>(std::ceil(std::sqrt(static_cast<f64>(width) * height / target))));
+    cellHeight = cellWidth;
+    cellsX = (width + cellWidth - 1) / cellWidth;
+    cellsY = (height + cellHeight - 1) / cellHeight;
+
+    // The arrays are cleared rather than destroyed, so a rebuild reuses them
+    cells.assign(static_cast<std::size_t>(cellsX) * cellsY, -1);
+    centroidCells.assign(cells.size(), -1);
+    nodes.clear();
+    freeNodes = -1;
+    large.clear();
+
+    boxes.resize(n);
+    centroids.resize(n);
+    for (i32 i = 0; i < n; ++i) {
+        boxes[i] = boundingBox(triangles[i]);
+        centroids[i] = centroid(triangles[i]);
+        add(i);
+    }
+}
+
+SpatialIndex::Box SpatialIndex::boundingBox(Triangle const& t) const noexcept {
+    return {
+        std::clamp(std::min({t.a.x, t.b.x, t.c.x}), 0, width - 1),
+        std::clamp(std::min({t.a.y, t.b.y, t.c.y}), 0, height - 1),
+        std::clamp(std::max({t.a.x, t.b.x, t.c.x}), 0, width - 1),
+        std::clamp(std::max({t.a.y, t.b.y, t.c.y}), 0, height - 1)
+    };
+}
+
+bool SpatialIndex::isLarge(Box const& box) const noexcept {
+    i32 columns = box.maxX / cellWidth - box.minX / cellWidth + 1;
+    i32 rows = box.maxY / cellHeight - box.minY / cellHeight + 1;
+    return columns * rows > MAX_CELLS;
+}
+
+i32 SpatialIndex::centroidCell(Point<i32> p) const noexcept {
+    i32 x = std::clamp(p.x, 0, width - 1) / cellWidth;
+    i32 y = std::clamp(p.y, 0, height - 1) / cellHeight;
+    return y * cellsX + x;
+}
+
+template <typename F>
+void SpatialIndex::forEachCell(Box const& box, F&& f) const {
+    for (i32 y = box.minY / cellHeight; y <= box.maxY / cellHeight; ++y) {
+        for (i32 x = box.minX / cellWidth; x <= box.maxX / cellWidth; ++x)
+            f(y * cellsX + x);
+    }
+}
+
+template <typename F>
+void SpatialIndex::forEachInList(i32 head, F&& f) const {
+    for (i32 node = head; node >= 0; node = nodes[node].next)
+        f(nodes[node].index);
+}
+
+void SpatialIndex::pushNode(i32& head, i32 index) {
+    i32 node = freeNodes;
+    if (node >= 0) {
+        freeNodes = nodes[node].next;
+        nodes[node] = {index, head};
+    } else {
+        node = static_cast<i32>(nodes.size());
+        nodes.push_back({index, head});
+    }
+    head = node;
+}
+
+void SpatialIndex::removeNode(i32& head, i32 index) {
+    for (i32* link = &head; *link >= 0; link = &nodes[*link].next) {
+        i32 node = *link;
+        if (nodes[node].index == index) {
+            *link = nodes[node].next;
+            nodes[node].next = freeNodes;
+            freeNodes = node;
+            return;
+        }
+    }
+}
+
+void SpatialIndex::add(i32 index) {
+    Box const& box = boxes[index];
+    if (isLarge(box))
+        large.push_back(index);
+    else
+        forEachCell(box, [&](i32 cell) { pushNode(cells[cell], index); });
+    pushNode(centroidCells[centroidCell(centroids[index])], index);
+}
+
+void SpatialIndex::remove(i32 index) {
+    Box const& box = boxes[index];
+    if (isLarge(box))
+        eraseValue(large, index);
+    else
+        forEachCell(box, [&](i32 cell) { removeNode(cells[cell], index); });
+    removeNode(centroidCells[centroidCell(centroids[index])], index);
+}
+
+void SpatialIndex::shift(i32 from, i32 delta) {
+    // The free nodes are shifted too, they are overwritten when reused
+    for (Node& node : nodes) {
+        if (node.index >= from)
+            node.index += delta;
+    }
+    for (i32& i : large) {
+        if (i >= from)
+            i += delta;
+    }
+}
+
+void SpatialIndex::insert(i32 index, Triangle const& triangle) {
+    if (index < size())
+        shift(index, 1);
+    boxes.insert(boxes.begin() + index, boundingBox(triangle));
+    centroids.insert(centroids.begin() + index, centroid(triangle));
+    add(index);
+}
+
+void SpatialIndex::erase(i32 index) {
+    remove(index);
+    boxes.erase(boxes.begin() + index);
+    centroids.erase(centroids.begin() + index);
+    if (index < size())
+        shift(index + 1, -1);
+}
+
+void SpatialIndex::truncate(i32 size) {
+    size = std::min(size, this->size());
+    for (i32 i = this->size() - 1; i >= size; --i) {
+        if (!isLarge(boxes[i]))
+            forEachCell(boxes[i], [&](i32 cell) { removeNode(cells[cell], i); });
+        removeNode(centroidCells[centroidCell(centroids[i])], i);
+    }
+    // In one pass, there can be many large triangles
+    large.erase(std::remove_if(large.begin(), large.end(), [&](i32 i) { return i >= size; }), large.end());
+    boxes.resize(size);
+    centroids.resize(size);
+}
+
+void SpatialIndex::update(i32 index, Triangle const& triangle) {
+    remove(index);
+    boxes[index] = boundingBox(triangle);
+    centroids[index] = centroid(triangle);
+    add(index);
+}
+
+void SpatialIndex::swap(i32 i, i32 j) {
+    remove(i);
+    remove(j);
+    std::swap(boxes[i], boxes[j]);
+    std::swap(centroids[i], centroids[j]);
+    add(i);
+    add(j);
+}
+
+void SpatialIndex::overlapping(i32 x0, i32 y0, i32 x1, i32 y1, std::vector<i32>& out) const {
+    out.clear();
+    Box rect {std::max(x0, 0), std::max(y0, 0), std::min(x1, width - 1), std::min(y1, height - 1)};
+    if (rect.minX > rect.maxX || rect.minY > rect.maxY)
+        return;
+
+    auto overlaps = [&](Box const& box) {
+        return box.minX <= rect.maxX && rect.minX <= box.maxX && box.minY <= rect.maxY && rect.minY <= box.maxY;
+    };
+
+    // A triangle is listed in every cell it overlaps, marks remove the duplicates
+    if (marks.size() < boxes.size())
+        marks.resize(boxes.size(), mark);
+    if (++mark == 0) {
+        std::fill(marks.begin(), marks.end(), 0);
+        mark = 1;
+    }
+
+    forEachCell(rect, [&](i32 cell) {
+        forEachInList(cells[cell], [&](i32 i) {
+            if (marks[i] != mark && overlaps(boxes[i])) {
+                marks[i] = mark;
+                out.push_back(i);
+            }
+        });
+    });
+    for (i32 i : large) {
+        if (overlaps(boxes[i]))
+            out.push_back(i);
+    }
+    std::sort(out.begin(), out.end());
+}
+
+void SpatialIndex::nearest(Point<i32> p, i32 k, std::vector<i32>& out, i32 exclude) const {
+    out.clear();
+    candidates.clear();
+    if (k <= 0 || boxes.empty())
+        return;
+
+    auto distance = [&](i32 i) {
+        i64 dx = centroids[i].x - p.x;
+        i64 dy = centroids[i].y - p.y;
+        return dx * dx + dy * dy;
+    };
+    auto visit = [&](i32 x, i32 y) {
+        if (x < 0 || x >= cellsX || y < 0 || y >= cellsY)
+            return;
+        forEachInList(centroidCells[y * cellsX + x], [&](i32 i) {
+            if (i != exclude)
+                candidates.push_back({distance(i), i});
+        });
+    };
+
+    // Rings of cells around the cell of p, until no unvisited cell can be nearer than the
+    // k-th candidate
+    const i32 cx = std::clamp(p.x, 0, width - 1) / cellWidth;
+    const i32 cy = std::clamp(p.y, 0, height - 1) / cellHeight;
+    const i32 maxRing = std::max(cellsX, cellsY);
+    constexpr i64 INF = std::numeric_limits<i64>::max();
+    for (i32 r = 0; r <= maxRing; ++r) {
+        if (r == 0) {
+            visit(cx, cy);
+        } else {
+            for (i32 x = cx - r; x <= cx + r; ++x) {
+                visit(x, cy - r);
+                visit(x, cy + r);
+            }
+            for (i32 y = cy - r + 1; y <= cy + r - 1; ++y) {
+                visit(cx - r, y);
+                visit(cx + r, y);
+            }
+        }
+
+        if (static_cast<i32>(candidates.size()) < k)
+            continue;
+
+        // Lower bound of the distance to the cells outside of the ring
+        i64 bound = INF;
+        if (cx - r > 0)
+            bound = std::min<i64>(bound, p.x - static_cast<i64>(cx - r) * cellWidth + 1);
+        if (cx + r + 1 < cellsX)
+            bound = std::min<i64>(bound, static_cast<i64>(cx + r + 1) * cellWidth - p.x);
+        if (cy - r > 0)
+            bound = std::min<i64>(bound, p.y - static_cast<i64>(cy - r) * cellHeight + 1);
+        if (cy + r + 1 < cellsY)
+            bound = std::min<i64>(bound, static_cast<i64>(cy + r + 1) * cellHeight - p.y);
+
+        std::nth_element(candidates.begin(), candidates.begin() + (k - 1), candidates.end());
+        if (bound == INF || (bound > 0 && candidates[k - 1].first <= bound * bound))
+            break;
+    }
+
+    i32 count = std::min<i32>(k, static_cast<i32>(candidates.size()));
+    std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end());
+    for (i32 i = 0; i < count; ++i)
+        out.push_back(candidates[i].second);
+}
+
+GA_NAMESPACE_END
@@ -0,0 +1,100 @@
+#ifndef GENALGO_SPATIALINDEX_HPP
+#define GENALGO_SPATIALINDEX_HPP
+
+#include "base.hpp"
+#include "Point.hpp"
+#include "Triangle.hpp"
+#include <utility>
+#include <vector>
+
+GA_NAMESPACE_BEGIN
+
+// Uniform grid over the triangles of an individual, by index in the individual.
+//   - Each cell lists the triangles whose bounding box overlaps it. Triangles overlapping
+//     more than MAX_CELLS cells are kept in a separate list, so large triangles don't fill
+//     the grid: they are checked by every query.
+//   - Each cell of a second grid lists the triangles whose centroid is in it.
+// The grid has about one triangle per cell when it's built. Updates are incremental, but
+// inserting or erasing shifts the indices that follow, in O(size of the index), except at
+// the end. The lists of the cells are linked through a single pool of nodes, so building
+// or copying an index only clears or copies a few arrays.
+class SpatialIndex {
+public:
+    static constexpr i32 MAX_CELLS = 16;
+
+    void build(std::vector<Triangle> const& triangles, i32 width, i32 height);
+
+    // The triangle is inserted before the index-th one
+    void insert(i32 index, Triangle const& triangle);
+    void erase(i32 index);
+    // The index-th triangle changed
+    void update(i32 index, Triangle const& triangle);
+    // The triangles i and j were swapped
+    void swap(i32 i, i32 j);
+    // Keeps the first size triangles
+    void truncate(i32 size);
+
+    // Indices of the triangles whose bounding box overlaps x0 <= x <= x1, y0 <= y <= y1,
+    // in increasing order (the drawing order)
+    void overlapping(i32 x0, i32 y0, i32 x1, i32 y1, std::vector<i32>& out) const;
+
+    // Indices of the k triangles whose centroids are the nearest to p, nearest first,
+    // excluding the one at index exclude
+    void nearest(Point<i32> p, i32 k, std::vector<i32>& out, i32 exclude = -1) const;
+
+    i32 size() const noexcept { return static_cast<i32>(boxes.size()); }
+private:
+    // Bounding box, in pixels, clamped to the image
+    struct Box {
+        i32 minX, minY, maxX, maxY;
+    };
+
+    Box boundingBox(Triangle const& t) const noexcept;
+    bool isLarge(Box const& box) const noexcept;
+    i32 centroidCell(Point<i32> centroid) const noexcept;
+
+    // Calls f(cell) for each cell overlapped by the box
+    template <typename F>
+    void forEachCell(Box const& box, F&& f) const;
+
+    // Calls f(index) for each triangle of the list starting at the node head
+    template <typename F>
+    void forEachInList(i32 head, F&& f) const;
+
+    void pushNode(i32& head, i32 index);
+    void removeNode(i32& head, i32 index);
+
+    void add(i32 index);
+    void remove(i32 index);
+    void shift(i32 from, i32 delta);
+
+    i32 width = 0, height = 0;
+    i32 cellsX = 1, cellsY = 1;
+    i32 cellWidth = 1, cellHeight = 1;
+
+    // Node of a list of triangles, next is -1 at the end of the list
+    struct Node {
+        i32 index;
+        i32 next;
+    };
+
+    // First node of the list of each cell, or -1
+    std::vector<i32> cells;
+    std::vector<i32> centroidCells;
+    std::vector<Node> nodes;
+    i32 freeNodes = -1;
+    std::vector<i32> large;
+
+    // Of each triangle
+    std::vector<Box> boxes;
+    std::vector<Point<i32>> centroids;
+
+    // Scratch space of the queries
+    mutable std::vector<u32> marks;
+    mutable u32 mark = 0;
+    mutable std::vector<std::pair<i64, i32>> candidates;
+};
+
+GA_NAMESPACE_END
+
+#endif // GENALGO_SPATIALINDEX_HPP
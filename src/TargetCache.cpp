@@ -0,0 +1,222 @@
+#include "TargetCache.hpp"
+
+#include "Color.hpp"
+#include "TileLayout.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+GA_NAMESPACE_BEGIN
+
+// Bump when the layout or the content of the file changes
+constexpr u32 CACHE_VERSION = 2;
+constexpr char CACHE_MAGIC[8] = {'G', 'A', 'T', 'A', 'R', 'G', 'E', 'T'};
+
+// Sections start at multiples of the alignment, so they can be used in place
+constexpr u64 SECTION_ALIGNMENT = 64;
+
+enum Section : i32 {
+    pixelsSection,
+    weightsSection,
+    premultipliedSection,
+    tiledTargetSection,
+    tiledWeightsSection,
+    tileOrderSection,
+    integralSection,
+    numSections
+};
+
+struct TargetCacheSection {
+    u64 offset;
+    u64 size;
+};
+
+struct TargetCacheHeader {
+    char magic[8];
+    u32 version;
+    i32 weightMap;
+    u64 contentHash;
+    i32 width, height;
+    TargetCacheSection sections[numSections];
+};
+
+// Expected size of each section
+static void sectionSizes(i32 width, i32 height, u64 sizes[numSections]) {
+    const u64 pixels = static_cast<u64>(width) * height;
+    std::fill(sizes, sizes + numSections, 0);
+    sizes[pixelsSection] = pixels * 4;
+    sizes[weightsSection] = pixels * sizeof(f64);
+    sizes[premultipliedSection] = pixels * sizeof(Vec3d);
+    sizes[tiledTargetSection] = pixels * sizeof(Vec3f);
+    sizes[tiledWeightsSection] = pixels * sizeof(f64);
+    sizes[tileOrderSection] = pixels * sizeof(i32);
+    sizes[integralSection] = static_cast<u64>(width + 1) * (height + 1) * sizeof(Vec3d);
+}
+
+u64 hashContent(void const* data, std::size_t size) noexcept {
+    u64 hash = 0xcbf29ce484222325ull;
+    u8 const* bytes = static_cast<u8 const*>(data);
+    for (std::size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+std::string TargetCache::path(const char* dir, u64 contentHash, WeightMap weightMap) {
+    char name[64];
+    std::snprintf(name, sizeof(name), "%016llx-%d.gatarget", contentHash, static_cast<i32>(weightMap));
+    return (std::filesystem::path(dir) / name).string();
+}
+
+std::unique_ptr<TargetCache> TargetCache::map(std::string const& path, u64 contentHash, WeightMap weightMap) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<u64>(st.st_size) < sizeof(TargetCacheHeader)) {
+        ::close(fd);
+        return nullptr;
+    }
+
+    std::size_t size = static_cast<std::size_t>(st.st_size);
+    void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED)
+        return nullptr;
+
+    std::unique_ptr<TargetCache> cache(new TargetCache());
+    cache->mapping = mapping;
+    cache->size = size;
+    cache->header = static_cast<TargetCacheHeader const*>(mapping);
+
+    TargetCacheHeader const& header = *cache->header;
+    if (std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0
+            || header.version != CACHE_VERSION
+            || header.contentHash != contentHash
+            || header.weightMap != static_cast<i32>(weightMap)
+            || header.width <= 0 || header.height <= 0)
+        return nullptr;
+
+    u64 sizes[numSections];
+    sectionSizes(header.width, header.height, sizes);
+    for (i32 i = 0; i < numSections; ++i) {
+        TargetCacheSection const& section = header.sections[i];
+        if (section.size != sizes[i] || section.offset % SECTION_ALIGNMENT != 0 || section.offset + section.size > size)
+            return nullptr;
+    }
+    return cache;
+}
+
+bool TargetCache::write(std::string const& path, u64 contentHash, WeightMap weightMap, Image& image) {
+    const i32 width = image.getWidth();
+    const i32 height = image.getHeight();
+    const i32 pixels = width * height;
+
+    // Everything derived from the target
+    Color const* target = reinterpret_cast<Color const*>(image.getData());
+    Vec3d const* premultiplied = image.getPremultiplied();
+    f64 const* weights = image.getWeights();
+    Vec3d const* integral = image.getIntegral().data();
+
+    std::vector<i32> tileOrder(pixels);
+    computeTileOrder(width, height, tileOrder.data());
+
+    std::vector<Vec3f> tiledTarget(pixels);
+    std::vector<f64> tiledWeights(pixels);
+    for (i32 j = 0; j < pixels; ++j) {
+        Color c = target[tileOrder[j]];
+        tiledTarget[j] = (c.a / 255.0f) * Vec3f{1.0f * c.r, 1.0f * c.g, 1.0f * c.b};
+        tiledWeights[j] = weights[tileOrder[j]];
+    }
+
+    // Layout of the file
+    TargetCacheHeader header {};
+    std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.version = CACHE_VERSION;
+    header.weightMap = static_cast<i32>(weightMap);
+    header.contentHash = contentHash;
+    header.width = width;
+    header.height = height;
+
+    void const* data[numSections] = {};
+    data[pixelsSection] = target;
+    data[weightsSection] = weights;
+    data[premultipliedSection] = premultiplied;
+    data[tiledTargetSection] = tiledTarget.data();
+    data[tiledWeightsSection] = tiledWeights.data();
+    data[tileOrderSection] = tileOrder.data();
+    data[integralSection] = integral;
+
+    u64 expected[numSections];
+    sectionSizes(width, height, expected);
+    u64 offset = sizeof(TargetCacheHeader);
+    for (i32 i = 0; i < numSections; ++i) {
+        offset = (offset + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT;
+        header.sections[i] = {offset, expected[i]};
+        offset += expected[i];
+    }
+
+    std::error_code error;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), error);
+
+    // Written to a temporary file, then renamed, so concurrent runs never see a partial file
+    std::string tmpPath = path + ".tmp." + std::to_string(getpid());
+    {
+        std::ofstream os(tmpPath, std::ios::binary);
+        if (!os)
+            return false;
+
+        os.write(reinterpret_cast<char const*>(&header), sizeof(header));
+        u64 position = sizeof(header);
+        for (i32 i = 0; i < numSections; ++i) {
+            static const char zeros[SECTION_ALIGNMENT] = {};
+            os.write(zeros, header.sections[i].offset - position);
+            os.write(static_cast<char const*>(data[i]), header.sections[i].size);
+            position = header.sections[i].offset + header.sections[i].size;
+        }
+
+        if (!os.flush()) {
+            std::remove(tmpPath.c_str());
+            return false;
+        }
+    }
+
+    if (std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+        std::remove(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+TargetCache::~TargetCache() {
+    if (mapping)
+        munmap(mapping, size);
+}
+
+template <typename T>
+T* TargetCache::section(i32 index) const noexcept {
+    return reinterpret_cast<T*>(static_cast<char*>(mapping) + header->sections[index].offset);
+}
+
+i32 TargetCache::getWidth() const noexcept { return header->width; }
+i32 TargetCache::getHeight() const noexcept { return header->height; }
+
+u8* TargetCache::getPixels() const noexcept { return section<u8>(pixelsSection); }
+f64* TargetCache::getWeights() const noexcept { return section<f64>(weightsSection); }
+Vec3d* TargetCache::getPremultiplied() const noexcept { return section<Vec3d>(premultipliedSection); }
+Vec3d const* TargetCache::getIntegral() const noexcept { return section<Vec3d>(integralSection); }
+
+Vec3f const* TargetCache::getTiledTarget() const noexcept { return section<Vec3f>(tiledTargetSection); }
+f64 const* TargetCache::getTiledWeights() const noexcept { return section<f64>(tiledWeightsSection); }
+i32 const* TargetCache::getTileOrder() const noexcept { return section<i32>(tileOrderSection); }
+
+GA_NAMESPACE_END
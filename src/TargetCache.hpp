@@ -0,0 +1,68 @@
+#ifndef GENALGO_TARGETCACHE_HPP
+#define GENALGO_TARGETCACHE_HPP
+
+#include "base.hpp"
+#include "Image.hpp"
+#include "Vec.hpp"
+#include <cstddef>
+#include <memory>
+#include <string>
+
+GA_NAMESPACE_BEGIN
+
+struct TargetCacheHeader;
+
+// Preprocessed target, memory-mapped from a cache file named after the hash of the
+// content of the image file. It holds everything derived from the target: the RGBA
+// pixels, the weight map, the premultiplied target of the CPU engines and its integral
+// image, and the tiled target of the CUDA engine.
+//
+// The mapping is private and writable: writes are copy-on-write and never reach the
+// file. The format depends on the machine (native endianness and layout), files of
+// another version or target are ignored and rewritten.
+class TargetCache {
+public:
+    TargetCache(TargetCache const&) = delete;
+    TargetCache& operator=(TargetCache const&) = delete;
+    ~TargetCache();
+
+    // Path of the cache file of the content in dir
+    static std::string path(const char* dir, u64 contentHash, WeightMap weightMap);
+
+    // Maps the cache file. Returns nullptr if it doesn't exist or isn't valid for this content.
+    static std::unique_ptr<TargetCache> map(std::string const& path, u64 contentHash, WeightMap weightMap);
+
+    // Writes the cache file of the image (already prepared), replacing it atomically
+    static bool write(std::string const& path, u64 contentHash, WeightMap weightMap, Image& image);
+
+    i32 getWidth() const noexcept;
+    i32 getHeight() const noexcept;
+
+    u8* getPixels() const noexcept;
+    f64* getWeights() const noexcept;
+    Vec3d* getPremultiplied() const noexcept;
+
+    // Sums of the IntegralImage of the premultiplied target
+    Vec3d const* getIntegral() const noexcept;
+
+    // Tiled layout (see TileLayout.hpp) of the premultiplied target and of the weights
+    Vec3f const* getTiledTarget() const noexcept;
+    f64 const* getTiledWeights() const noexcept;
+    i32 const* getTileOrder() const noexcept;
+private:
+    TargetCache() = default;
+
+    template <typename T>
+    T* section(i32 index) const noexcept;
+
+    void* mapping = nullptr;
+    std::size_t size = 0;
+    TargetCacheHeader const* header = nullptr;
+};
+
+// FNV-1a hash of the content of a file
+u64 hashContent(void const* data, std::size_t size) noexcept;
+
+GA_NAMESPACE_END
+
+#endif // GENALGO_TARGETCACHE_HPP
@@ -0,0 +1,34 @@
+#ifndef GENALGO_TILELAYOUT_HPP
+#define GENALGO_TILELAYOUT_HPP
+
+#include "base.hpp"
+
+GA_NAMESPACE_BEGIN
+
+// Canvases of the CUDA engine are stored in tiles of TILE_SIZE x TILE_SIZE pixels: tiles
+// row by row, the pixels of each tile row by row. The last row and column of tiles may
+// be smaller.
+constexpr i32 TILE_SIZE = 16;
+
+// order[j] is the index in the image of the j-th pixel of the tiled layout
+inline void computeTileOrder(i32 width, i32 height, i32 order[]) {
+    i32 j = 0;
+    for (i32 tileY = 0; tileY < (height + TILE_SIZE - 1) / TILE_SIZE; ++tileY) {
+        for (i32 tileX = 0; tileX < (width + TILE_SIZE - 1) / TILE_SIZE; ++tileX) {
+            for (i32 dy = 0; dy < TILE_SIZE; dy++) {
+                for (i32 dx = 0; dx < TILE_SIZE; dx++) {
+                    i32 y = tileY * TILE_SIZE + dy;
+                    i32 x = tileX * TILE_SIZE + dx;
+                    if (x >= width || y >= height)
+                        continue;
+
+                    order[j++] = y * width + x;
+                }
+            }
+        }
+    }
+}
+
+GA_NAMESPACE_END
+
+#endif // GENALGO_TILELAYOUT_HPP
@@ -4,6 +4,7 @@
 #include "GlobalConfig.hpp"
 #include "globalRNG.hpp"
 #include <algorithm>
+#include <iterator>
 #include <type_traits>
 
 GA_NAMESPACE_BEGIN
@@ -164,30 +165,19 @@ bool Triangle::mutateFineRotate() {
 }
 
 bool Triangle::mutate() {
-    f64 prob = randomF64(0, 1);
-    bool mutated = false;
-
-    if (prob < globalCfg.mutationShapeFineColorChance)
-        return mutateFineColor();
-    prob -= globalCfg.mutationShapeFineColorChance;
-
-    if (prob < globalCfg.mutationShapeFineMoveXChance)
-        return mutateFineMoveX();
-    prob -= globalCfg.mutationShapeFineMoveXChance;
-
-    if (prob < globalCfg.mutationShapeFineMoveYChance)
-        return mutateFineMoveY();
-    prob -= globalCfg.mutationShapeFineMoveYChance;
-
-    if (prob < globalCfg.mutationShapeFineScaleChance)
-        return mutateFineScale();
-    prob -= globalCfg.mutationShapeFineScaleChance;
-
-    if (prob < globalCfg.mutationShapeFineRotateChance)
-        return mutateFineRotate();
-    prob -= globalCfg.mutationShapeFineRotateChance;
+    // Same order as GlobalConfig::buildMutationTables, the last one is no mutation
+    static constexpr bool (Triangle::*mutations[])() = {
+        &Triangle::mutateFineColor,
+        &Triangle::mutateFineMoveX,
+        &Triangle::mutateFineMoveY,
+        &Triangle::mutateFineScale,
+        &Triangle::mutateFineRotate
+    };
 
-    return mutated;
+    if (globalCfg.shapeMutationTable.empty())
+        return false;
+    i32 i = globalCfg.shapeMutationTable.sample(randomU32());
+    return i < static_cast<i32>(std::size(mutations)) && (this->*mutations[i])();
 }
 
 void Triangle::merge(Triangle const& other) {
@@ -0,0 +1,56 @@
+#ifndef GENALGO_TRIPLEBUFFER_HPP
+#define GENALGO_TRIPLEBUFFER_HPP
+
+#include "base.hpp"
+#include <atomic>
+
+GA_NAMESPACE_BEGIN
+
+// Lock-free single-producer/single-consumer triple buffer.
+//
+// The producer fills back() and publishes it, the consumer acquires the most
+// recently published slot and reads it through front(). Neither side ever blocks
+// and slots are reused, so publishing does not allocate once the slots are warm.
+template <typename T>
+class TripleBuffer {
+public:
+    TripleBuffer() = default;
+
+    TripleBuffer(const TripleBuffer&) = delete;
+    TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+    // Producer only
+    T& back() noexcept { return slots[backIndex]; }
+
+    void publish() noexcept {
+        u8 old = middle.exchange(backIndex | DIRTY_BIT, std::memory_order_acq_rel);
+        backIndex = old & INDEX_MASK;
+    }
+
+    // Consumer only
+    // Returns true if a new slot has been published since the last call.
+    bool acquire() noexcept {
+        if (!(middle.load(std::memory_order_relaxed) & DIRTY_BIT))
+            return false;
+
+        // Only the producer may modify middle meanwhile, and it always sets DIRTY_BIT
+        u8 old = middle.exchange(frontIndex, std::memory_order_acq_rel);
+        frontIndex = old & INDEX_MASK;
+        return true;
+    }
+
+    T const& front() const noexcept { return slots[frontIndex]; }
+
+private:
+    static constexpr u8 INDEX_MASK = 0x3;
+    static constexpr u8 DIRTY_BIT = 0x4;
+
+    T slots[3];
+    u8 backIndex = 0;
+    u8 frontIndex = 1;
+    std::atomic<u8> middle = 2;
+};
+
+GA_NAMESPACE_END
+
+#endif // GENALGO_TRIPLEBUFFER_HPP
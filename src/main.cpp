@@ -1,22 +1,26 @@
 #include <SFML/Graphics/Image.hpp>
+#include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <csignal>
 #include <cstring>
 #include <iomanip>
 #include <iostream>
 #include <fstream>
-#include <stack>
 #include "AppState.hpp"
-#include "CudaFitnessEngine.hpp"
+#include "CPURenderer.hpp"
+#include "ErrorGuide.hpp"
 #include "FitnessEngine.hpp"
+#include "ImageWriter.hpp"
 #include "Individual.hpp"
 #include "JSONDeserializer.hpp"
 #include "JSONSerializer.hpp"
-#include "MTFitnessEngine.hpp"
+#include "Lineage.hpp"
+#include "Metrics.hpp"
+#include "MutationRates.hpp"
 #include "PoorProfiler.hpp"
 #include "Population.hpp"
 #include "SFMLRenderer.hpp"
-#include "STFitnessEngine.hpp"
 #include "SignalHandler.hpp"
 #include "Vec.hpp"
 #include "defer.hpp"
@@ -84,24 +88,11 @@ int main() {
         return 1;
     }
 
-    auto engine = []() -> std::unique_ptr<FitnessEngine> {
-        std::string fitnessEngine = globalCfg.fitnessEngine;
-        for (char& c : fitnessEngine)
-            c = std::toupper(c);
-
-        if (fitnessEngine == "CUDA") {
-            return std::make_unique<CudaFitnessEngine>();
-        } else if (fitnessEngine == "MT") {
-            return std::make_unique<MTFitnessEngine>();
-        } else if (fitnessEngine == "ST") {
-            return std::make_unique<STFitnessEngine>();
-        } else {
-            std::cerr << "genalgo: Unknown fitness engine: " << globalCfg.fitnessEngine << std::endl;
-            return nullptr;
-        }
-    }();
-    if (engine == nullptr)
+    std::unique_ptr<FitnessEngine> engine = createFitnessEngine(globalCfg.fitnessEngine, globalCfg.fitnessMetric);
+    if (engine == nullptr) {
+        std::cerr << "genalgo: Unknown fitness engine: " << globalCfg.fitnessEngine << std::endl;
         return 1;
+    }
     
     // Display the name of the engine
     const char* engineName = engine->getEngineName();
@@ -112,6 +103,16 @@ int main() {
     if (!globalCfg.renderDisabled)
         renderer = new SFMLRenderer();
 
+    CPURenderer timelapseRenderer(globalCfg.timelapseScale, globalCfg.supersample);
+    std::vector<Color> timelapseFrame;
+    Y4MWriter timelapse;
+    if (globalCfg.timelapseFilename) {
+        if (!timelapse.open(globalCfg.timelapseFilename, timelapseRenderer.getWidth(), timelapseRenderer.getHeight(), 30)) {
+            std::cerr << "genalgo: Failed to open file " << globalCfg.timelapseFilename << std::endl;
+            return 1;
+        }
+    }
+
     Individual bestIndividual;
     f64 oldBestFitness = std::numeric_limits<f64>::max();
     auto shouldStop = [&]() {
@@ -122,39 +123,107 @@ int main() {
     u32 renderPeriod = globalCfg.renderPeriod;
     u32 logPeriod = globalCfg.logPeriod;
 
+    profiler.setThreadName("main");
+    if (globalCfg.perfCounters)
+        profiler.enablePerfCounters();
+    profiler.setDisplayName(ProfilerZone::evaluation, engineName);
+    if (globalCfg.traceFilename && !profiler.startTrace(globalCfg.traceFilename)) {
+        std::cerr << "genalgo: Failed to open file " << globalCfg.traceFilename << std::endl;
+        return 1;
+    }
+
+    MetricsWriter metrics;
+    if (!metrics.open(globalCfg.metricsFilename, globalCfg.prometheusFilename)) {
+        std::cerr << "genalgo: Failed to open file " << globalCfg.metricsFilename << std::endl;
+        return 1;
+    }
+    PopulationStats populationStats;
+
+    if (globalCfg.genealogyFilename && !lineage.open(globalCfg.genealogyFilename)) {
+        std::cerr << "genalgo: Failed to open file " << globalCfg.genealogyFilename << std::endl;
+        return 1;
+    }
+
+    using Clock = std::chrono::steady_clock;
+    const Clock::time_point startTime = Clock::now();
+    Clock::time_point lastLogTime = startTime;
+
     std::cout << std::fixed << std::setprecision(2);
     for (i64 cGen = 1; !shouldStop(); ++cGen, ++nGen) {
-        profiler.start("loop");
+        profiler.start(ProfilerZone::loop);
 
-        profiler.start("evaluation", engineName);
+        profiler.start(ProfilerZone::evaluation);
         pop.evaluate(*engine);
-        profiler.stop("evaluation");
+        profiler.stop(ProfilerZone::evaluation);
+
+        i32 bestIndex = -1;
+        std::vector<Individual> const& individuals = pop.getIndividuals();
+        if (globalCfg.lineage)
+            lineage.evaluate(individuals, nGen);
 
-        for (Individual const& i : pop.getIndividuals()) {
+        for (i32 k = 0; k < static_cast<i32>(individuals.size()); ++k) {
+            Individual const& i = individuals[k];
             if (i.getWeightedFitness() < bestIndividual.getWeightedFitness()) {
                 bestIndividual = i;
+                bestIndex = k;
             } else if (i.getWeightedFitness() == bestIndividual.getWeightedFitness()) {
                 if (i.size() < bestIndividual.size()) {
                     bestIndividual = i;
+                    bestIndex = k;
                 }
             }
         }
 
-        profiler.start("render", "Render");
+        // The error map follows the best individual, while its canvas is still in the engine
+        if (bestIndex >= 0 && globalCfg.errorGuidedChance > 0) {
+            profiler.start(ProfilerZone::errorGuide);
+            errorGuide.update(*engine, bestIndividual, bestIndex);
+            profiler.stop(ProfilerZone::errorGuide);
+        }
+
+        // The children are ranked before breeding replaces them
+        if (globalCfg.adaptiveMutation)
+            mutationRates.update(individuals);
+
+        // The population must be sampled before breeding replaces it with unevaluated children
+        bool logGeneration = logPeriod && cGen % logPeriod == 0;
+        if (logGeneration && metrics.isOpen())
+            populationStats = PopulationStats::compute(pop);
+
+        // Pruned before the triangles that don't help are passed on to the children, and
+        // after the error guide, which needs the canvas of the unpruned best individual
+        PruneReport pruneReport;
+        if (logGeneration && globalCfg.prune) {
+            profiler.start(ProfilerZone::prune);
+            pruneReport = pop.prune(globalCfg.pruneElites ? globalCfg.eliteSize : 1, globalCfg.pruneThreshold);
+            if (pruneReport.best >= 0)
+                bestIndividual = pop.getIndividuals()[pruneReport.best];
+            profiler.stop(ProfilerZone::prune);
+        }
+
+        profiler.start(ProfilerZone::render);
         if (renderPeriod && cGen % renderPeriod == 0) {
             if (renderer)
                 renderer->requestRender(nGen, bestIndividual, pop);
         }
-        profiler.stop("render");
+        profiler.stop(ProfilerZone::render);
+
+        profiler.start(ProfilerZone::timelapse);
+        if (timelapse.isOpen() && globalCfg.timelapsePeriod && cGen % globalCfg.timelapsePeriod == 0) {
+            timelapseRenderer.render(bestIndividual, timelapseFrame);
+            if (!timelapse.writeFrame(timelapseFrame.data()))
+                std::cerr << "genalgo: Failed to write timelapse frame" << std::endl;
+        }
+        profiler.stop(ProfilerZone::timelapse);
 
         if (!globalCfg.breedDisabled) {
-            profiler.start("breed", "Breed");
+            profiler.start(ProfilerZone::breed);
             pop = pop.breed();
-            profiler.stop("breed");
+            profiler.stop(ProfilerZone::breed);
         }
 
-        profiler.stop("loop");
-        if (logPeriod && cGen % logPeriod == 0) {
+        profiler.stop(ProfilerZone::loop);
+        if (logGeneration) {
             std::cout << "Generation " << nGen << '\n';
             std::cout << "Seed " << globalCfg.seed << '\n';
             
@@ -166,41 +235,155 @@ int main() {
             std::cout << "Best individual: " << bestIndividual.size() << " " <<
                 bestIndividual.getFitness() << " (improvement = " << 100.0 * decrease << "%)\n";
 
-            ProfilerStopwatch& sLoop = profiler.getStopwatch("loop");
-            auto printTime = [&](std::string_view name, i32 level, double time, bool printPercent = true) {
+            if (globalCfg.adaptiveMutation) {
+                std::cout << "Mutation rates:";
+                for (i32 op = 0; op < MutationRates::OPERATOR_COUNT; ++op) {
+                    std::cout << (op ? ", " : " ") << MutationRates::operatorName(op) << " = " << MutationRates::getChance(op)
+                              << " (" << 100 * mutationRates.getSuccessRate(op) << "% success)";
+                }
+                std::cout << '\n';
+            }
+
+            if (!globalCfg.cullDisabled) {
+                CullStats cull = engine->collectCullStats();
+                f64 generations = globalCfg.logPeriod;
+                std::cout << "Culled triangles per generation: " << cull.culled() / generations << " of "
+                          << cull.total / generations << " (transparent = " << cull.transparent / generations
+                          << ", outside = " << cull.outside / generations << ", occluded = "
+                          << cull.occluded / generations << ")\n";
+            }
+
+            if (globalCfg.prune) {
+                std::cout << "Pruned " << pruneReport.removed << " triangles of " << pruneReport.pruned
+                          << " individuals, rasterization of the best reduced by " << 100 * pruneReport.savedFraction << "%\n";
+
+                std::vector<f64>& contributions = pruneReport.contributions;
+                if (!contributions.empty()) {
+                    std::sort(contributions.begin(), contributions.end());
+                    auto quantile = [&](f64 q) {
+                        return contributions[static_cast<std::size_t>(q * (contributions.size() - 1))];
+                    };
+                    std::cout << "Contributions of the triangles of the best: min = " << quantile(0)
+                              << ", p10 = " << quantile(0.1) << ", p50 = " << quantile(0.5)
+                              << ", p90 = " << quantile(0.9) << ", max = " << quantile(1) << '\n';
+                }
+            }
+
+            OperatorReport operatorReport;
+            if (globalCfg.lineage) {
+                operatorReport = lineage.collect();
+                std::cout << "Mutation operators (per generation):\n";
+                for (i32 op = 0; op < MutationRates::OPERATOR_COUNT; ++op) {
+                    OperatorStats const& stats = operatorReport[op];
+                    f64 applications = std::max<i64>(stats.applications, 1);
+                    std::cout << "  - " << MutationRates::operatorName(op) << ": "
+                              << static_cast<f64>(stats.applications) / globalCfg.logPeriod << " children, "
+                              << 100 * stats.improvements / applications << "% improved, mean delta = "
+                              << stats.fitnessDelta / applications << ", "
+                              << 1e6 * stats.seconds / globalCfg.logPeriod << "us\n";
+                }
+                std::cout << "Best of the generation kept as elite for "
+                          << lineage.eliteAge(lineage.getBestIndex()) << " generations\n";
+            }
+
+            ProfilerReport report = profiler.collect();
+            ProfilerZoneStats const& sLoop = report[ProfilerZone::loop];
+            auto printTime = [&](std::string_view name, i32 level, ProfilerZoneStats const& stats, bool printPercent = true) {
                 if (level > 0) {
                     for (i32 i = 0; i < level; ++i)
                         std::cout << "  ";
                     std::cout << "- ";
                 }
 
-                std::cout << name << ": " << 1000 * time / globalCfg.logPeriod << "ms";
+                std::cout << name << ": " << 1000 * stats.elapsed / globalCfg.logPeriod << "ms";
                 if (printPercent) {
-                    std::cout << " (" << 100 * time / sLoop.elapsed() << "%)";
+                    std::cout << " (" << 100 * stats.elapsed / sLoop.elapsed << "%)";
                 }
+                std::cout << " [p50 = " << 1000 * stats.p50 << "ms, p99 = " << 1000 * stats.p99
+                          << "ms, max = " << 1000 * stats.max << "ms]";
                 std::cout << '\n';
             };
 
-            std::stack<ProfilerStopwatch const*> stopwatchStack;
-            auto& stopwatches = profiler.getStopwatches();
-            for (i32 i = 1; i < stopwatches.size(); ++i) {
-                ProfilerStopwatch const& sw = stopwatches[i];
+            // Pixels evaluated during the log period, misses are reported per pixel
+            f64 pixels = static_cast<f64>(globalCfg.logPeriod) * globalCfg.populationSize *
+                globalCfg.targetImage.getWidth() * globalCfg.targetImage.getHeight();
+            auto printPerf = [&](i32 level, ProfilerZone zone, ProfilerZoneStats const& stats) {
+                bool hasIPC = stats.hasPerf(PerfCounter::cycles) && stats.hasPerf(PerfCounter::instructions)
+                    && stats.getPerf(PerfCounter::cycles) > 0;
+                if (!hasIPC && !stats.hasPerf(PerfCounter::llcMisses) && !stats.hasPerf(PerfCounter::branchMisses))
+                    return;
+
+                for (i32 i = 0; i < level + 1; ++i)
+                    std::cout << "  ";
+                std::cout << "  {";
+                const char* separator = "";
+
+                // Counters are per thread: the evaluation zone only counts the thread that runs
+                // it, the workers of the MT engine are counted in its sub-zones
+                if (zone == ProfilerZone::evaluation) {
+                    std::cout << "main thread";
+                    separator = ": ";
+                }
+                if (hasIPC) {
+                    std::cout << "IPC = " << static_cast<f64>(stats.getPerf(PerfCounter::instructions)) /
+                        stats.getPerf(PerfCounter::cycles);
+                    separator = ", ";
+                }
 
-                while (!stopwatchStack.empty() && !sw.parentIs(stopwatchStack.top()))
-                    stopwatchStack.pop();
+                // Outside of the evaluation there are no pixels, print the totals per generation
+                bool perPixel = zone != ProfilerZone::evaluation
+                    && profilerZoneIsWithin(zone, ProfilerZone::evaluation);
+                f64 divisor = perPixel ? pixels : globalCfg.logPeriod;
+                const char* unit = perPixel ? "/px" : "/gen";
+                if (stats.hasPerf(PerfCounter::llcMisses)) {
+                    std::cout << separator << "LLC misses" << unit << " = "
+                              << stats.getPerf(PerfCounter::llcMisses) / divisor;
+                    separator = ", ";
+                }
+                if (stats.hasPerf(PerfCounter::branchMisses)) {
+                    std::cout << separator << "branch misses" << unit << " = "
+                              << stats.getPerf(PerfCounter::branchMisses) / divisor;
+                }
+                std::cout << "}\n";
+            };
 
-                printTime(sw.name(), stopwatchStack.size(), sw.elapsed());
-                stopwatchStack.push(&sw);
+            // Zones are declared in depth-first order, so they are printed as a tree
+            for (i32 i = 0; i < PROFILER_ZONE_COUNT; ++i) {
+                ProfilerZone zone = static_cast<ProfilerZone>(i);
+                if (zone == ProfilerZone::loop || report[zone].count == 0)
+                    continue;
+
+                // Zones outside of the loop (e.g. other threads) are not part of the total
+                bool inLoop = profilerZoneParent(zone) != ProfilerZone::none;
+                i32 level = std::max(0, profilerZoneDepth(zone) - 1);
+                printTime(profiler.getDisplayName(zone), level, report[zone], inLoop);
+                printPerf(level, zone, report[zone]);
             }
-            printTime("Total", 0, sLoop.elapsed(), false);
+            printTime("Total", 0, sLoop, false);
+            printPerf(0, ProfilerZone::loop, sLoop);
 
-            for (ProfilerStopwatch& sw : stopwatches) {
-                sw.reset();
+            Clock::time_point now = Clock::now();
+            if (metrics.isOpen()) {
+                f64 periodSeconds = std::chrono::duration<f64>(now - lastLogTime).count();
+                MetricsRecord record {
+                    .generation = nGen,
+                    .generations = logPeriod,
+                    .elapsed = std::chrono::duration<f64>(now - startTime).count(),
+                    .generationsPerSecond = periodSeconds > 0 ? logPeriod / periodSeconds : 0,
+                    .population = populationStats,
+                    .report = report,
+                    .operators = globalCfg.lineage ? &operatorReport : nullptr
+                };
+                if (!metrics.write(record))
+                    std::cerr << "genalgo: Failed to write metrics" << std::endl;
             }
+            lastLogTime = now;
 
+            profiler.flushTrace();
             std::cout.flush();
         }
     }
+    profiler.stopTrace();
 
     if (globalCfg.outputFilename) {
         std::ofstream output(globalCfg.outputFilename);
@@ -226,6 +409,16 @@ int main() {
             bestIndividual.toSVG(stream);
         }
     }
+
+    if (globalCfg.outputImage) {
+        CPURenderer imageRenderer(globalCfg.svgScale, globalCfg.supersample);
+        std::vector<Color> pixels;
+        imageRenderer.render(bestIndividual, pixels);
+        if (!writeImage(globalCfg.outputImage, pixels.data(), imageRenderer.getWidth(), imageRenderer.getHeight())) {
+            std::cerr << "genalgo: Failed to write file " << globalCfg.outputImage << std::endl;
+            std::cerr << "         Unable to save image!" << std::endl;
+        }
+    }
     return 0;
 }
 